@@ -0,0 +1,15 @@
+#version 450 core
+
+layout(location = 0) in vec3 position;
+layout(location = 1) in float parameter;
+
+uniform mat4 u_mvp;
+
+layout(location = 1) out vec4 v_color;
+
+void main()
+{
+	gl_Position = u_mvp * vec4(position, 1);
+	// blue at the oldest point of a trail, red at its head
+	v_color = vec4(parameter, 0, 1 - parameter, 1);
+}
@@ -0,0 +1,386 @@
+// microbenchmarks for the field kernels and the tracer step, results as csv or json for regression tracking
+// build together with curl_noise_batch.cpp, curl_noise_batch_avx2.cpp and curl_noise_batch_avx512.cpp
+// and with -D_RELEASE for throughput numbers, the profiling column says which build produced a result
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <functional>
+#include <iostream>
+#include <random>
+#include <sstream>
+#include <string>
+#include <vector>
+
+#include "defines.h"
+#include "curl_noise.h"
+#include "curl_noise_batch.h"
+#include "field_scene.h"
+#include "velocity_grid.h"
+#include "perf_counters.h"
+#include "profiler.h"
+#include "thread_pool.h"
+#include "tracer.h"
+
+struct BenchmarkResult
+{
+	std::string kernel;
+	std::string variant;
+	std::string region;
+	size_t tracers;
+	unsigned int threads;
+	size_t samples; // kernel calls or tracer-steps
+	double seconds;
+	CounterValues counters; // per sample, averaged over every repetition
+};
+
+// sample positions of one region, the cost of the field differs a lot between them
+struct SamplePoints
+{
+	std::string region;
+	std::vector<float> x;
+	std::vector<float> y;
+	std::vector<float> z;
+};
+
+static SamplePoints make_samples(const std::string& region, size_t count, std::mt19937& rng)
+{
+	std::uniform_real_distribution<float> unit(0.0f, 1.0f);
+	SamplePoints points;
+	points.region = region;
+	points.x.resize(count);
+	points.y.resize(count);
+	points.z.resize(count);
+	for (size_t i = 0; i < count; i++)
+	{
+		float angle = unit(rng) * 6.2831853f;
+		float p[3];
+		if (region == "ring")
+		{
+			// within a unit of the main rotor vortex ring
+			float r = 5.95f + (unit(rng) * 2.0f - 1.0f);
+			p[0] = r * cosf(angle);
+			p[1] = unit(rng) * 2.0f - 1.0f;
+			p[2] = r * sinf(angle);
+		}
+		else if (region == "occluder")
+		{
+			// inside of the fuselage ellipsoid
+			float local[3];
+			do
+			{
+				for (int k = 0; k < 3; k++) local[k] = unit(rng) * 2.0f - 1.0f;
+			} while (dot(local, local) > 1.0f);
+			p[0] = local[0] * 1.0f;
+			p[1] = local[1] * 1.6f - 1.6f;
+			p[2] = local[2] * 4.5f;
+		}
+		else
+		{
+			// outside of every primitive's support
+			float r = 14.0f + unit(rng) * 6.0f;
+			p[0] = r * cosf(angle);
+			p[1] = unit(rng) * 20.0f - 10.0f;
+			p[2] = r * sinf(angle);
+		}
+		points.x[i] = p[0];
+		points.y[i] = p[1];
+		points.z[i] = p[2];
+	}
+	return points;
+}
+
+// best of repetitions, the minimum is the least disturbed by the rest of the machine
+static double time_best(int repetitions, const std::function<void()>& fn)
+{
+	double best = 1e30;
+	for (int r = 0; r < repetitions; r++)
+	{
+		auto start = std::chrono::steady_clock::now();
+		fn();
+		best = std::min(best, std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count());
+	}
+	return best;
+}
+
+// time_best that also counts the hardware events of all repetitions, per_sample gets them divided by samples per repetition
+static double measure(int repetitions, size_t samples, PerfCounters* perf, CounterValues* per_sample, const std::function<void()>& fn)
+{
+	if (!perf) return time_best(repetitions, fn);
+	perf->start();
+	double seconds = time_best(repetitions, fn);
+	*per_sample = perf->stop();
+	for (double& value : per_sample->values) value /= static_cast<double>(repetitions) * samples;
+	return seconds;
+}
+
+static std::vector<size_t> parse_list(const char* text)
+{
+	std::vector<size_t> values;
+	std::stringstream stream(text);
+	std::string item;
+	while (std::getline(stream, item, ','))
+	{
+		if (!item.empty()) values.push_back(static_cast<size_t>(atof(item.c_str())));
+	}
+	return values;
+}
+
+static void write_csv(std::ostream& output, const std::vector<BenchmarkResult>& results)
+{
+	// counters the machine does not have are left empty
+	output << "kernel,variant,region,tracers,threads,profiling,samples,seconds,ns_per_sample,samples_per_second";
+	for (int c = 0; c < HARDWARE_COUNTER_COUNT; c++) output << ',' << hardware_counter_name(static_cast<HardwareCounter>(c)) << "_per_sample";
+	output << ",ipc\n";
+	for (const BenchmarkResult& r : results)
+	{
+		output << r.kernel << ',' << r.variant << ',' << r.region << ',' << r.tracers << ',' << r.threads << ',' << PROFILING << ','
+			<< r.samples << ',' << r.seconds << ',' << r.seconds * 1e9 / r.samples << ',' << r.samples / r.seconds;
+		const CounterValues& c = r.counters;
+		for (int i = 0; i < HARDWARE_COUNTER_COUNT; i++)
+		{
+			output << ',';
+			if (c.available[i]) output << c.values[i];
+		}
+		output << ',';
+		if (c.available[static_cast<int>(HardwareCounter::Cycles)] && c.available[static_cast<int>(HardwareCounter::Instructions)])
+		{
+			output << c.values[static_cast<int>(HardwareCounter::Instructions)] / c.values[static_cast<int>(HardwareCounter::Cycles)];
+		}
+		output << '\n';
+	}
+}
+
+static void write_json(std::ostream& output, const std::vector<BenchmarkResult>& results)
+{
+	output << "[\n";
+	for (size_t i = 0; i < results.size(); i++)
+	{
+		const BenchmarkResult& r = results[i];
+		output << "  {\"kernel\": \"" << r.kernel << "\", \"variant\": \"" << r.variant << "\", \"region\": \"" << r.region
+			<< "\", \"tracers\": " << r.tracers << ", \"threads\": " << r.threads << ", \"profiling\": " << (PROFILING ? "true" : "false") << ", \"samples\": " << r.samples
+			<< ", \"seconds\": " << r.seconds << ", \"ns_per_sample\": " << r.seconds * 1e9 / r.samples
+			<< ", \"samples_per_second\": " << r.samples / r.seconds;
+		for (int c = 0; c < HARDWARE_COUNTER_COUNT; c++)
+		{
+			if (r.counters.available[c]) output << ", \"" << hardware_counter_name(static_cast<HardwareCounter>(c)) << "_per_sample\": " << r.counters.values[c];
+		}
+		output << "}" << (i + 1 < results.size() ? "," : "") << "\n";
+	}
+	output << "]\n";
+}
+
+static void print_usage()
+{
+	std::cout << "usage: benchmark [options]\n"
+		<< "  -f csv|json   output format (csv)\n"
+		<< "  -o file       output file, stdout if not given\n"
+		<< "  -n samples    field samples per region and kernel (200000)\n"
+		<< "  -c counts     comma separated tracer counts for the tracer step (3375,100000)\n"
+		<< "  -t threads    comma separated thread counts for the tracer step (1,2,4,.. up to the hardware)\n"
+		<< "  -l count      trail length in line segments per tracer (20)\n"
+		<< "  -r radius     vortex ring radius (5.95)\n"
+		<< "  -k            field kernels only, skip the tracer step\n"
+		<< "  -m            hardware counters per sample through perf_event_open, linux only\n";
+}
+
+int main(int argc, char** argv)
+{
+	std::string format = "csv";
+	std::string output_path;
+	size_t sample_count = 200000;
+	std::vector<size_t> tracer_counts = { 3375, 100000 };
+	std::vector<size_t> thread_counts;
+	int l_trace_count = 20;
+	float radius = 5.95f;
+	bool kernels_only = false;
+	bool hardware_counters = false;
+	const int repetitions = 3;
+
+	for (int a = 1; a < argc; a++)
+	{
+		if (strcmp(argv[a], "-f") == 0 && a + 1 < argc) format = argv[++a];
+		else if (strcmp(argv[a], "-o") == 0 && a + 1 < argc) output_path = argv[++a];
+		else if (strcmp(argv[a], "-n") == 0 && a + 1 < argc) sample_count = static_cast<size_t>(atof(argv[++a]));
+		else if (strcmp(argv[a], "-c") == 0 && a + 1 < argc) tracer_counts = parse_list(argv[++a]);
+		else if (strcmp(argv[a], "-t") == 0 && a + 1 < argc) thread_counts = parse_list(argv[++a]);
+		else if (strcmp(argv[a], "-l") == 0 && a + 1 < argc) l_trace_count = atoi(argv[++a]);
+		else if (strcmp(argv[a], "-r") == 0 && a + 1 < argc) radius = static_cast<float>(atof(argv[++a]));
+		else if (strcmp(argv[a], "-k") == 0) kernels_only = true;
+		else if (strcmp(argv[a], "-m") == 0) hardware_counters = true;
+		else
+		{
+			print_usage();
+			return 1;
+		}
+	}
+	if ((format != "csv" && format != "json") || sample_count == 0 || l_trace_count <= 0)
+	{
+		print_usage();
+		return 1;
+	}
+	if (thread_counts.empty())
+	{
+		unsigned int hardware = std::max(1u, std::thread::hardware_concurrency());
+		for (unsigned int t = 1; t < hardware; t *= 2) thread_counts.push_back(t);
+		thread_counts.push_back(hardware);
+	}
+
+	// before any thread pool, the counters only follow threads started after them
+	PerfCounters perf_counters;
+	PerfCounters* perf = hardware_counters && perf_counters.open() ? &perf_counters : nullptr;
+
+	std::vector<BenchmarkResult> results;
+	std::mt19937 rng(1234);
+	float center[3] = { 0.0f, 0.0f, 0.0f };
+	const float ring_normal[3] = { 0.0f, 1.0f, 0.0f };
+	volatile float sink = 0.0f;
+
+	CompiledScene scene;
+	compile_scene(default_scene(), radius, &scene);
+	ThreadPool bake_pool;
+	VelocityGrid grid;
+	grid.init(glm::vec3(-12.0f, -12.0f, -12.0f), glm::vec3(12.0f, 6.0f, 12.0f), 97, 73, 97);
+	grid.build(scene, bake_pool);
+	// the neighbouring radius keyframe, for the blended lookup behind the vortex ring slider
+	CompiledScene next_scene;
+	compile_scene(default_scene(), radius + 5.95f / 4, &next_scene);
+	VelocityGrid next_grid;
+	next_grid.init(glm::vec3(-12.0f, -12.0f, -12.0f), glm::vec3(12.0f, 6.0f, 12.0f), 97, 73, 97);
+	next_grid.build(next_scene, bake_pool);
+
+	const char* regions[] = { "ring", "occluder", "far" };
+	for (const char* region : regions)
+	{
+		SamplePoints points = make_samples(region, sample_count, rng);
+		std::vector<float> vx(sample_count), vy(sample_count), vz(sample_count);
+
+		// scalar kernels, one point at a time
+		struct ScalarKernel
+		{
+			const char* kernel;
+			const char* variant;
+			std::function<void(float x[], float out[])> fn;
+		};
+		std::vector<ScalarKernel> kernels = {
+			// the building blocks the field spends its time in
+			{ "potential_vortex_ring", "scalar", [&](float x[], float out[]) { potential_vortex_ring(5.95f, radius, center, ring_normal, x, out); } },
+			{ "length", "scalar", [&](float x[], float out[]) { out[0] = length(x); } },
+			{ "normalise", "scalar", [&](float x[], float out[]) { out[0] = x[0]; out[1] = x[1]; out[2] = x[2]; normalise(out); } },
+			{ "potential_field", "scalar", [&](float x[], float out[]) { potential_field(x, out, center, radius); } },
+			{ "potential_deriv", "fd", [&](float x[], float out[]) { float dy[3], dz[3]; potential_deriv(center, radius, x, out, dy, dz); } },
+			{ "potential_deriv", "analytic", [&](float x[], float out[]) { float dy[3], dz[3]; potential_deriv_analytic(center, radius, x, out, dy, dz); } },
+			{ "velocity_field", "fd", [&](float x[], float out[]) { velocity_field_fd(x, out, center, radius); } },
+			{ "velocity_field", "analytic", [&](float x[], float out[]) { velocity_field_analytic(x, out, center, radius); } },
+			{ "velocity_field", "scene", [&](float x[], float out[]) { velocity_field(x, out, scene); } },
+			{ "velocity_field", "grid_trilinear", [&](float x[], float out[]) { grid.sample_trilinear(x, out); } },
+			{ "velocity_field", "grid_tricubic", [&](float x[], float out[]) { grid.sample_tricubic(x, out); } },
+			{ "velocity_field", "grid_keyframes", [&](float x[], float out[]) { grid.sample_trilinear(x, out, &next_grid, 0.5f); } },
+			{ "velocity_field", "grid_keyframes_tricubic", [&](float x[], float out[]) { grid.sample_tricubic(x, out, &next_grid, 0.5f); } },
+		};
+		for (const ScalarKernel& kernel : kernels)
+		{
+			CounterValues counters;
+			double seconds = measure(repetitions, sample_count, perf, &counters, [&]()
+			{
+				float sum = 0.0f;
+				for (size_t i = 0; i < sample_count; i++)
+				{
+					float x[3] = { points.x[i], points.y[i], points.z[i] };
+					float out[3] = { 0.0f, 0.0f, 0.0f };
+					kernel.fn(x, out);
+					sum += out[0];
+				}
+				sink = sink + sum;
+			});
+			results.push_back(BenchmarkResult{ kernel.kernel, kernel.variant, region, 0, 1, sample_count, seconds, counters });
+		}
+
+		// batch kernels for every instruction set this cpu supports
+		for (int level = static_cast<int>(SimdLevel::Scalar); level <= static_cast<int>(simd_level()); level++)
+		{
+			CounterValues counters;
+			double seconds = measure(repetitions, sample_count, perf, &counters, [&]()
+			{
+				velocity_field_batch(static_cast<SimdLevel>(level), points.x.data(), points.y.data(), points.z.data(),
+					vx.data(), vy.data(), vz.data(), sample_count, center, radius);
+				sink = sink + vx[0];
+			});
+			results.push_back(BenchmarkResult{ "velocity_field_batch", simd_level_name(static_cast<SimdLevel>(level)), region, 0, 1, sample_count, seconds, counters });
+		}
+		std::cerr << "kernels done for region " << region << std::endl;
+	}
+
+	if (!kernels_only)
+	{
+		const float tracing_height = 8.0f;
+		const float tracing_width = 15.0f;
+		for (size_t requested : tracer_counts)
+		{
+			// closest tracer grid with at least the requested number of tracers
+			int side = std::max(1, static_cast<int>(std::ceil(std::cbrt(static_cast<double>(requested)) - 1e-9)));
+			int k_trace_count = std::max(1, static_cast<int>((requested + side * side - 1) / (side * side)));
+			size_t tracer_count = static_cast<size_t>(side) * side * k_trace_count;
+			ParticleStore initial;
+			Trails trails;
+			init_tracers(&initial, &trails, side, side, k_trace_count, l_trace_count, tracing_width, tracing_height);
+			for (size_t threads : thread_counts)
+			{
+				ThreadPool thread_pool(static_cast<unsigned int>(threads));
+				struct Variant
+				{
+					const char* name;
+					const VelocityGrid* grid;
+					Integrator integrator;
+				};
+				Variant variants[] = {
+					{ "analytic", nullptr, Integrator::Euler },
+					{ "grid_trilinear", &grid, Integrator::Euler },
+					{ "analytic_rk4", nullptr, Integrator::RK4 },
+					{ "analytic_rk45", nullptr, Integrator::RK45 },
+				};
+				for (const Variant& variant : variants)
+				{
+					ParticleStore particles = initial;
+					IntegratorSettings settings;
+					settings.integrator = variant.integrator;
+					if (variant.integrator == Integrator::RK45) enable_adaptive_step(&particles, 0.005f);
+					CounterValues counters;
+					double seconds = measure(repetitions, tracer_count, perf, &counters, [&]()
+					{
+						thread_pool.parallel_for(tracer_count, 16, [&](size_t begin, size_t end)
+						{
+							calculate_new_positions(begin, end, &particles, scene, 0.005f, variant.grid, GridInterpolation::Trilinear, settings);
+						});
+					});
+					results.push_back(BenchmarkResult{ "calculate_new_positions", variant.name, "tracers", tracer_count, thread_pool.getThread_count(), tracer_count, seconds, counters });
+				}
+				std::cerr << "tracer step done for " << tracer_count << " tracers on " << threads << " threads" << std::endl;
+			}
+		}
+	}
+
+	std::ofstream file;
+	if (!output_path.empty())
+	{
+		file.open(output_path);
+		if (!file.is_open())
+		{
+			std::cout << "Error writing benchmark file " << output_path << std::endl;
+			return 1;
+		}
+	}
+	std::ostream& output = output_path.empty() ? std::cout : file;
+	if (format == "json")
+	{
+		write_json(output, results);
+	}
+	else
+	{
+		write_csv(output, results);
+	}
+	return 0;
+}
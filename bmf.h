@@ -0,0 +1,198 @@
+#pragma once
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#include <vector>
+
+#include "defines.h"
+#include "mapped_file.h"
+
+// binary model file, version 2
+// header | mesh table | per mesh vertex block and index block, every section starts on a BMF_ALIGNMENT boundary
+// positions are in meters, the blocks are stored exactly as they are uploaded so nothing is parsed on load
+// version 1 files (mesh count followed by the meshes inline, positions in feet) are converted with bmf_upgrade
+#define BMF_VERSION 2
+#define BMF_ALIGNMENT 64
+
+struct BmfHeader
+{
+	char magic[4];          // "BMF2"
+	uint32 version;
+	uint32 mesh_count;
+	uint32 vertex_stride;   // sizeof(ModelVertex)
+	uint32 index_size;      // sizeof(uint32)
+	uint32 reserved0;
+	uint64 mesh_table_offset;
+	uint64 file_size;
+	uint8 reserved[24];
+};
+
+struct BmfMeshEntry
+{
+	Material material;
+	uint32 reserved;
+	uint64 vertex_offset;
+	uint64 vertex_count;
+	uint64 index_offset;
+	uint64 index_count;
+};
+
+static_assert(sizeof(BmfHeader) == 64, "BmfHeader is part of the file format");
+static_assert(sizeof(BmfMeshEntry) == 80, "BmfMeshEntry is part of the file format");
+static_assert(sizeof(ModelVertex) == 24, "ModelVertex is part of the file format");
+
+// view into a mapped file, valid as long as the BmfFile is open
+template <typename T>
+struct Span
+{
+	const T* data;
+	uint64 size;
+};
+
+struct BmfMesh
+{
+	const Material* material;
+	Span<ModelVertex> vertices;
+	Span<uint32> indices;
+};
+
+// maps a version 2 .bmf and hands out its meshes without copying
+class BmfFile
+{
+public:
+	bool open(const char* path)
+	{
+		mesh_table = nullptr;
+		mesh_count = 0;
+		if (!file.open(path)) return false;
+		const uint8* data = file.data();
+		uint64 size = file.size();
+
+		BmfHeader header;
+		if (size < sizeof(BmfHeader))
+		{
+			std::cout << path << " is not a .bmf file" << std::endl;
+			return false;
+		}
+		memcpy(&header, data, sizeof(BmfHeader));
+		if (memcmp(header.magic, "BMF", 3) != 0)
+		{
+			std::cout << path << " has no .bmf header, version 1 files have to be converted with bmf_upgrade" << std::endl;
+			return false;
+		}
+		if (header.version != BMF_VERSION)
+		{
+			std::cout << path << " is .bmf version " << header.version << ", expected " << BMF_VERSION << std::endl;
+			return false;
+		}
+		if (header.vertex_stride != sizeof(ModelVertex) || header.index_size != sizeof(uint32) || header.file_size != size)
+		{
+			std::cout << path << " has an unexpected layout or is truncated" << std::endl;
+			return false;
+		}
+		if (header.mesh_table_offset % BMF_ALIGNMENT != 0 || !in_bounds(header.mesh_table_offset, header.mesh_count, sizeof(BmfMeshEntry)))
+		{
+			std::cout << path << " has a broken mesh table" << std::endl;
+			return false;
+		}
+		const BmfMeshEntry* entries = reinterpret_cast<const BmfMeshEntry*>(data + header.mesh_table_offset);
+		for (uint32 i = 0; i < header.mesh_count; i++)
+		{
+			const BmfMeshEntry& entry = entries[i];
+			if (entry.vertex_offset % BMF_ALIGNMENT != 0 || entry.index_offset % BMF_ALIGNMENT != 0
+				|| !in_bounds(entry.vertex_offset, entry.vertex_count, sizeof(ModelVertex))
+				|| !in_bounds(entry.index_offset, entry.index_count, sizeof(uint32)))
+			{
+				std::cout << path << " mesh " << i << " points outside the file" << std::endl;
+				return false;
+			}
+		}
+		mesh_table = entries;
+		mesh_count = header.mesh_count;
+		return true;
+	}
+
+	uint32 getMesh_count() const
+	{
+		return mesh_count;
+	}
+
+	BmfMesh getMesh(uint32 i) const
+	{
+		const BmfMeshEntry& entry = mesh_table[i];
+		BmfMesh mesh;
+		mesh.material = &entry.material;
+		mesh.vertices = Span<ModelVertex>{ reinterpret_cast<const ModelVertex*>(file.data() + entry.vertex_offset), entry.vertex_count };
+		mesh.indices = Span<uint32>{ reinterpret_cast<const uint32*>(file.data() + entry.index_offset), entry.index_count };
+		return mesh;
+	}
+
+private:
+	bool in_bounds(uint64 offset, uint64 count, uint64 element_size) const
+	{
+		uint64 size = file.size();
+		return offset <= size && count <= (size - offset) / element_size;
+	}
+
+	MappedFile file;
+	const BmfMeshEntry* mesh_table = nullptr;
+	uint32 mesh_count = 0;
+};
+
+// one mesh to be written, positions already in meters
+struct BmfMeshData
+{
+	Material material;
+	std::vector<ModelVertex> vertices;
+	std::vector<uint32> indices;
+};
+
+inline uint64 bmf_align(uint64 offset)
+{
+	return (offset + BMF_ALIGNMENT - 1) / BMF_ALIGNMENT * BMF_ALIGNMENT;
+}
+
+inline bool write_bmf(const char* path, const std::vector<BmfMeshData>& meshes)
+{
+	BmfHeader header = {};
+	memcpy(header.magic, "BMF2", 4);
+	header.version = BMF_VERSION;
+	header.mesh_count = static_cast<uint32>(meshes.size());
+	header.vertex_stride = sizeof(ModelVertex);
+	header.index_size = sizeof(uint32);
+	header.mesh_table_offset = bmf_align(sizeof(BmfHeader));
+
+	std::vector<BmfMeshEntry> entries(meshes.size());
+	uint64 offset = bmf_align(header.mesh_table_offset + entries.size() * sizeof(BmfMeshEntry));
+	for (size_t i = 0; i < meshes.size(); i++)
+	{
+		BmfMeshEntry& entry = entries[i];
+		entry.material = meshes[i].material;
+		entry.reserved = 0;
+		entry.vertex_offset = offset;
+		entry.vertex_count = meshes[i].vertices.size();
+		offset = bmf_align(offset + entry.vertex_count * sizeof(ModelVertex));
+		entry.index_offset = offset;
+		entry.index_count = meshes[i].indices.size();
+		offset = bmf_align(offset + entry.index_count * sizeof(uint32));
+	}
+	header.file_size = offset;
+
+	std::vector<uint8> output(offset, 0);
+	memcpy(output.data(), &header, sizeof(BmfHeader));
+	if (!entries.empty()) memcpy(output.data() + header.mesh_table_offset, entries.data(), entries.size() * sizeof(BmfMeshEntry));
+	for (size_t i = 0; i < meshes.size(); i++)
+	{
+		if (!meshes[i].vertices.empty()) memcpy(output.data() + entries[i].vertex_offset, meshes[i].vertices.data(), meshes[i].vertices.size() * sizeof(ModelVertex));
+		if (!meshes[i].indices.empty()) memcpy(output.data() + entries[i].index_offset, meshes[i].indices.data(), meshes[i].indices.size() * sizeof(uint32));
+	}
+
+	std::ofstream file(path, std::ios::out | std::ios::binary);
+	if (!file.is_open())
+	{
+		std::cout << "Could not open " << path << " for writing" << std::endl;
+		return false;
+	}
+	file.write(reinterpret_cast<const char*>(output.data()), output.size());
+	return file.good();
+}
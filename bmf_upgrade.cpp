@@ -0,0 +1,80 @@
+// converts version 1 .bmf models (positions in feet, parsed value by value) to the mapped version 2 layout
+// only needs glm, build it from this file alone
+#include <fstream>
+#include <iostream>
+#include <vector>
+
+#include "defines.h"
+#include "bmf.h"
+
+#define FEET_TO_METER 3.28084
+
+// mesh count, then per mesh the material, vertex and index counts, the vertices as position and normal and the indices
+static bool read_bmf_v1(const char* path, std::vector<BmfMeshData>* meshes)
+{
+	std::ifstream input(path, std::ios::in | std::ios::binary);
+	if (!input.is_open())
+	{
+		std::cout << "Could not open " << path << std::endl;
+		return false;
+	}
+	uint64 num_meshes = 0;
+	input.read(reinterpret_cast<char*>(&num_meshes), sizeof(uint64));
+	if (!input || num_meshes == 0 || memcmp(&num_meshes, "BMF", 3) == 0)
+	{
+		std::cout << path << " is not a version 1 .bmf file" << std::endl;
+		return false;
+	}
+	meshes->resize(num_meshes);
+	for (BmfMeshData& mesh : *meshes)
+	{
+		uint64 num_vertices = 0;
+		uint64 num_indices = 0;
+		input.read(reinterpret_cast<char*>(&mesh.material), sizeof(Material));
+		input.read(reinterpret_cast<char*>(&num_vertices), sizeof(uint64));
+		input.read(reinterpret_cast<char*>(&num_indices), sizeof(uint64));
+		if (!input)
+		{
+			std::cout << path << " is truncated" << std::endl;
+			return false;
+		}
+		mesh.vertices.resize(num_vertices);
+		mesh.indices.resize(num_indices);
+		input.read(reinterpret_cast<char*>(mesh.vertices.data()), num_vertices * sizeof(ModelVertex));
+		input.read(reinterpret_cast<char*>(mesh.indices.data()), num_indices * sizeof(uint32));
+		if (!input)
+		{
+			std::cout << path << " is truncated" << std::endl;
+			return false;
+		}
+		for (ModelVertex& vertex : mesh.vertices)
+		{
+			vertex.position /= FEET_TO_METER;
+		}
+	}
+	return true;
+}
+
+int main(int argc, char** argv)
+{
+	if (argc != 3)
+	{
+		std::cout << "usage: bmf_upgrade input.bmf output.bmf" << std::endl;
+		return 1;
+	}
+	std::vector<BmfMeshData> meshes;
+	if (!read_bmf_v1(argv[1], &meshes)) return 1;
+	if (!write_bmf(argv[2], meshes)) return 1;
+
+	BmfFile check;
+	if (!check.open(argv[2])) return 1;
+	uint64 vertices = 0;
+	uint64 indices = 0;
+	for (const BmfMeshData& mesh : meshes)
+	{
+		vertices += mesh.vertices.size();
+		indices += mesh.indices.size();
+	}
+	std::cout << argv[2] << ": " << meshes.size() << " meshes, " << vertices << " vertices, " << indices << " indices" << std::endl;
+	return 0;
+}
@@ -0,0 +1,23 @@
+#pragma once
+#include "defines.h"
+
+// the graphics calls a streamed vertex buffer needs, implemented with OpenGL in gl_buffer_backend.h
+// and without any graphics api in recording_buffer_backend.h
+class BufferBackend
+{
+public:
+	virtual ~BufferBackend() {}
+
+	// immutable storage mapped for writing for the lifetime of the buffer, nullptr if the api does not support it
+	virtual void* create_persistent(uint64 bytes, const void* data) = 0;
+	// plain buffer updated with sub_data, used when there is no persistent mapping
+	virtual void create_dynamic(uint64 bytes, const void* data) = 0;
+	virtual void sub_data(uint64 offset, uint64 bytes, const void* data) = 0;
+
+	// fence after the draw calls reading a region, wait blocks until the gpu is done with them
+	virtual void* fence() = 0;
+	virtual void wait(void* fence) = 0;
+	virtual void delete_fence(void* fence) = 0;
+
+	virtual void bind() = 0;
+};
@@ -0,0 +1,220 @@
+// drives StreamingVertexBuffer through RecordingBufferBackend, no window or graphics api needed
+// checks that clean regions skip the upload, that invalidated ranges merge, that the regions rotate and catch up on
+// every range they missed, and that a region is only written after waiting on its fence, exits with 1 on a failure
+#include <cstdio>
+#include <cstring>
+#include <iostream>
+#include <vector>
+
+#include "defines.h"
+#include "recording_buffer_backend.h"
+#include "streaming_vertex_buffer.h"
+
+// same size as TracerVertex
+struct CheckVertex
+{
+	float position[3];
+	float age;
+};
+
+typedef RecordingBufferBackend::CallType CallType;
+
+static int failures = 0;
+
+static void check(bool ok, const char* what)
+{
+	printf("%-64s %s\n", what, ok ? "ok" : "FAILED");
+	if (!ok) failures++;
+}
+
+// distinct contents per frame, so a stale vertex never compares equal
+static void fill(std::vector<CheckVertex>* vertices, uint64 first, uint64 count, float frame)
+{
+	for (uint64 i = first; i < first + count; i++)
+	{
+		CheckVertex& v = (*vertices)[i];
+		v.position[0] = frame;
+		v.position[1] = static_cast<float>(i);
+		v.position[2] = frame * 1000.0f + i;
+		v.age = -frame;
+	}
+}
+
+static bool region_matches(const RecordingBufferBackend& backend, uint64 first_vertex, const std::vector<CheckVertex>& source)
+{
+	const uint8* region = backend.memory.data() + first_vertex * sizeof(CheckVertex);
+	return memcmp(region, source.data(), source.size() * sizeof(CheckVertex)) == 0;
+}
+
+static bool calls_since(const RecordingBufferBackend& backend, size_t first_call, CallType type, uint64 count)
+{
+	uint64 n = 0;
+	for (size_t c = first_call; c < backend.calls.size(); c++)
+	{
+		if (backend.calls[c].type == type) n++;
+	}
+	return n == count;
+}
+
+static void check_clean_skip(uint64 num_vertices)
+{
+	std::vector<CheckVertex> source(num_vertices);
+	fill(&source, 0, num_vertices, 0.0f);
+	RecordingBufferBackend backend;
+	StreamingVertexBuffer<CheckVertex> buffer(&backend, source.data(), num_vertices);
+	check(backend.count(CallType::CreatePersistent) == 1 && backend.memory.size() == 3 * num_vertices * sizeof(CheckVertex),
+		"persistent buffer holds three regions");
+	check(buffer.getRegion_count() == 3 && buffer.getFirst_vertex() == 0, "starts drawing region 0");
+	bool every_region = true;
+	for (int r = 0; r < 3; r++) every_region = every_region && region_matches(backend, r * num_vertices, source);
+	check(every_region, "every region starts with the initial vertices");
+
+	std::vector<CheckVertex> initial = source;
+	size_t calls = backend.calls.size();
+	fill(&source, 0, num_vertices, 1.0f);
+	bool uploaded = buffer.upload(source.data());
+	check(!uploaded && backend.calls.size() == calls && buffer.getFirst_vertex() == 0, "upload without invalidate does nothing");
+	check(region_matches(backend, 0, initial) && region_matches(backend, num_vertices, initial), "clean upload copies no vertices");
+
+	buffer.invalidate(0, 0);
+	check(!buffer.upload(source.data()), "empty invalidate keeps the buffer clean");
+
+	buffer.invalidate_all();
+	check(buffer.upload(source.data()) && region_matches(backend, num_vertices, source), "invalidate_all uploads into region 1");
+	check(!buffer.upload(source.data()) && buffer.getFirst_vertex() == num_vertices, "second upload of the same frame is skipped");
+}
+
+// without persistent mapping every merged range is one sub_data call, which makes the merging visible
+static void check_range_merging(uint64 num_vertices)
+{
+	std::vector<CheckVertex> source(num_vertices);
+	fill(&source, 0, num_vertices, 0.0f);
+	RecordingBufferBackend backend(false);
+	StreamingVertexBuffer<CheckVertex> buffer(&backend, source.data(), num_vertices);
+	check(backend.count(CallType::CreateDynamic) == 1 && backend.memory.size() == num_vertices * sizeof(CheckVertex)
+		&& buffer.getRegion_count() == 1, "without persistent mapping falls back to one dynamic region");
+
+	fill(&source, 0, num_vertices, 1.0f);
+	buffer.invalidate(40, 5);
+	buffer.invalidate(10, 5);
+	buffer.invalidate(12, 2);  // inside [10, 15)
+	buffer.invalidate(15, 5);  // touches [10, 15)
+	buffer.invalidate(44, 4);  // overlaps [40, 45)
+	buffer.invalidate(num_vertices - 2, 10); // clipped to the buffer
+	size_t calls = backend.calls.size();
+	check(buffer.upload(source.data()), "upload with pending ranges");
+	std::vector<RecordingBufferBackend::Call> sub_data;
+	for (size_t c = calls; c < backend.calls.size(); c++)
+	{
+		if (backend.calls[c].type == CallType::SubData) sub_data.push_back(backend.calls[c]);
+	}
+	const uint64 size = sizeof(CheckVertex);
+	check(sub_data.size() == 3
+		&& sub_data[0].offset == 10 * size && sub_data[0].bytes == 10 * size
+		&& sub_data[1].offset == 40 * size && sub_data[1].bytes == 8 * size
+		&& sub_data[2].offset == (num_vertices - 2) * size && sub_data[2].bytes == 2 * size,
+		"touching and overlapping ranges merge, sorted, clipped to the buffer");
+
+	std::vector<CheckVertex> expected(num_vertices);
+	fill(&expected, 0, num_vertices, 0.0f);
+	fill(&expected, 10, 10, 1.0f);
+	fill(&expected, 40, 8, 1.0f);
+	fill(&expected, num_vertices - 2, 2, 1.0f);
+	check(region_matches(backend, 0, expected), "only the invalidated vertices changed");
+
+	calls = backend.calls.size();
+	buffer.fence();
+	check(backend.calls.size() == calls && buffer.getFirst_vertex() == 0, "the single region needs no fence");
+
+	// the 33rd disjoint range collapses the list into one covering range
+	for (uint64 i = 0; i < 33; i++) buffer.invalidate(i * 3, 1);
+	calls = backend.calls.size();
+	buffer.upload(source.data());
+	check(calls_since(backend, calls, CallType::SubData, 1) && backend.calls.back().offset == 0 && backend.calls.back().bytes == 97 * size,
+		"many disjoint ranges collapse into one");
+}
+
+// one range changes per frame, the region drawn next has to catch up on the ranges of the frames it was not drawn in
+static void check_rotation(uint64 num_vertices)
+{
+	std::vector<CheckVertex> source(num_vertices);
+	fill(&source, 0, num_vertices, 0.0f);
+	RecordingBufferBackend backend;
+	StreamingVertexBuffer<CheckVertex> buffer(&backend, source.data(), num_vertices);
+	backend.release_fences();
+
+	bool rotates = true;
+	bool catches_up = true;
+	for (int frame = 1; frame <= 9; frame++)
+	{
+		uint64 first = (frame * 37) % (num_vertices - 16);
+		fill(&source, first, 16, static_cast<float>(frame));
+		buffer.invalidate(first, 16);
+		buffer.upload(source.data());
+		rotates = rotates && buffer.getFirst_vertex() == (frame % 3) * num_vertices;
+		catches_up = catches_up && region_matches(backend, buffer.getFirst_vertex(), source);
+		buffer.fence();
+		backend.release_fences();
+	}
+	check(rotates, "uploads rotate through regions 1, 2, 0");
+	check(catches_up, "every uploaded region matches the source");
+	check(backend.stalls == 0, "released fences never stall");
+}
+
+// the gpu never finishes on its own here, so the fourth upload reuses region 1 and has to wait on the first fence
+static void check_fence_waits(uint64 num_vertices)
+{
+	std::vector<CheckVertex> source(num_vertices);
+	fill(&source, 0, num_vertices, 0.0f);
+	RecordingBufferBackend backend;
+	{
+		StreamingVertexBuffer<CheckVertex> buffer(&backend, source.data(), num_vertices);
+		for (int frame = 1; frame <= 3; frame++)
+		{
+			fill(&source, 0, 8, static_cast<float>(frame));
+			buffer.invalidate(0, 8);
+			buffer.upload(source.data());
+			buffer.fence();
+		}
+		check(backend.count(CallType::Fence) == 3 && backend.count(CallType::Wait) == 0, "one fence per region, no wait while a region is free");
+
+		// the region still reads from its fence, not the one of an earlier frame
+		size_t calls = backend.calls.size();
+		fill(&source, 0, 8, 4.0f);
+		buffer.invalidate(0, 8);
+		buffer.upload(source.data());
+		check(calls_since(backend, calls, CallType::Wait, 1) && backend.calls[calls].fence == 1 && backend.stalls == 1,
+			"reusing region 1 waits on its unsignaled fence");
+		check(calls_since(backend, calls, CallType::DeleteFence, 1) && backend.calls[calls + 1].type == CallType::DeleteFence
+			&& backend.calls[calls + 1].fence == 1, "the fence is deleted right after the wait");
+		buffer.fence();
+
+		backend.release_fences();
+		calls = backend.calls.size();
+		fill(&source, 0, 8, 5.0f);
+		buffer.invalidate(0, 8);
+		buffer.upload(source.data());
+		check(calls_since(backend, calls, CallType::Wait, 1) && backend.calls[calls].fence == 2 && backend.stalls == 1,
+			"a signaled fence is waited on without a stall");
+		buffer.fence();
+
+		// a frame without changes draws the same region again and fences it again
+		calls = backend.calls.size();
+		buffer.upload(source.data());
+		buffer.fence();
+		check(backend.calls.size() == calls + 2 && backend.calls[calls].type == CallType::DeleteFence
+			&& backend.calls[calls + 1].type == CallType::Fence, "refencing a region replaces its fence");
+	}
+	check(backend.count(CallType::DeleteFence) == backend.count(CallType::Fence), "the destructor deletes the remaining fences");
+}
+
+int main()
+{
+	const uint64 num_vertices = 1000;
+	check_clean_skip(num_vertices);
+	check_range_merging(num_vertices);
+	check_rotation(num_vertices);
+	check_fence_waits(num_vertices);
+	if (failures) std::cout << failures << " checks failed" << std::endl;
+	return failures ? 1 : 0;
+}
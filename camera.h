@@ -21,6 +21,11 @@ public:
 		return vp;
 	}
 
+	glm::vec3 getPosition() const
+	{
+		return position;
+	}
+
 	virtual void update()
 	{
 		vp = projection * view;
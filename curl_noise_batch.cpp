@@ -0,0 +1,120 @@
+#include "curl_noise_batch.h"
+#include <cmath>
+#include <cstddef>
+
+#if defined(_M_X64) || defined(_M_IX86) || defined(__x86_64__) || defined(__i386__)
+#define CURL_NOISE_X86
+#define CURL_NOISE_SIMD_SSE
+#endif
+
+#if defined(CURL_NOISE_X86) && defined(_MSC_VER)
+#include <intrin.h>
+#endif
+
+#include "simd.h"
+#include "curl_noise_lanes.h"
+#include "curl_noise.h"
+
+#ifdef CURL_NOISE_X86
+// defined in curl_noise_batch_avx2.cpp and curl_noise_batch_avx512.cpp, which are compiled for their instruction set
+void velocity_field_batch_avx2(const float* x, const float* y, const float* z, float* vx, float* vy, float* vz, size_t count, const float center[], float radius);
+void velocity_field_batch_avx512(const float* x, const float* y, const float* z, float* vx, float* vy, float* vz, size_t count, const float center[], float radius);
+#endif
+
+static SimdLevel detect_simd_level()
+{
+#if defined(CURL_NOISE_X86) && defined(_MSC_VER)
+	int info[4];
+	__cpuid(info, 0);
+	int max_leaf = info[0];
+	__cpuid(info, 1);
+	bool fma = (info[2] & (1 << 12)) != 0;
+	bool osxsave = (info[2] & (1 << 27)) != 0;
+	bool avx = (info[2] & (1 << 28)) != 0;
+	bool avx2 = false;
+	bool avx512 = false;
+	if (max_leaf >= 7)
+	{
+		__cpuidex(info, 7, 0);
+		avx2 = (info[1] & (1 << 5)) != 0;
+		avx512 = (info[1] & (1 << 16)) != 0;
+	}
+	// the operating system has to save the wide registers on context switches
+	unsigned long long xcr0 = osxsave ? _xgetbv(0) : 0;
+	bool ymm = (xcr0 & 0x6) == 0x6;
+	bool zmm = (xcr0 & 0xe6) == 0xe6;
+	if (avx512 && zmm) return SimdLevel::AVX512;
+	if (avx && avx2 && fma && ymm) return SimdLevel::AVX2;
+	return SimdLevel::SSE;
+#elif defined(CURL_NOISE_X86)
+	__builtin_cpu_init();
+	if (__builtin_cpu_supports("avx512f")) return SimdLevel::AVX512;
+	if (__builtin_cpu_supports("avx2") && __builtin_cpu_supports("fma")) return SimdLevel::AVX2;
+	return SimdLevel::SSE;
+#else
+	return SimdLevel::Scalar;
+#endif
+}
+
+SimdLevel simd_level()
+{
+	static const SimdLevel level = detect_simd_level();
+	return level;
+}
+
+const char* simd_level_name(SimdLevel level)
+{
+	switch (level)
+	{
+	case SimdLevel::SSE:
+		return "sse";
+	case SimdLevel::AVX2:
+		return "avx2";
+	case SimdLevel::AVX512:
+		return "avx512";
+	default:
+		return "scalar";
+	}
+}
+
+void velocity_field_batch(
+	const float* x, const float* y, const float* z,
+	float* vx, float* vy, float* vz,
+	size_t count, float center[], float radius)
+{
+	velocity_field_batch(simd_level(), x, y, z, vx, vy, vz, count, center, radius);
+}
+
+void velocity_field_batch(
+	SimdLevel level,
+	const float* x, const float* y, const float* z,
+	float* vx, float* vy, float* vz,
+	size_t count, float center[], float radius)
+{
+	if (level > simd_level()) level = simd_level();
+	switch (level)
+	{
+#ifdef CURL_NOISE_X86
+	case SimdLevel::AVX512:
+		velocity_field_batch_avx512(x, y, z, vx, vy, vz, count, center, radius);
+		return;
+	case SimdLevel::AVX2:
+		velocity_field_batch_avx2(x, y, z, vx, vy, vz, count, center, radius);
+		return;
+	case SimdLevel::SSE:
+		velocity_field_batch_lanes<float_sse>(x, y, z, vx, vy, vz, count, center, radius);
+		return;
+#endif
+	default:
+		for (size_t i = 0; i < count; i++)
+		{
+			float pos[3] = { x[i], y[i], z[i] };
+			float vec[3] = { 0.0f, 0.0f, 0.0f };
+			velocity_field(pos, vec, center, radius);
+			vx[i] = vec[0];
+			vy[i] = vec[1];
+			vz[i] = vec[2];
+		}
+		return;
+	}
+}
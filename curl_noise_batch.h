@@ -0,0 +1,28 @@
+#pragma once
+#include <cstddef>
+
+// instruction sets the batch velocity field is compiled for, ordered by register width
+enum class SimdLevel
+{
+	Scalar,
+	SSE,
+	AVX2,
+	AVX512
+};
+
+// widest instruction set supported by this cpu and operating system, detected once
+SimdLevel simd_level();
+const char* simd_level_name(SimdLevel level);
+
+// velocity_field for count points given as separate x/y/z arrays, the instruction set is picked at runtime
+void velocity_field_batch(
+	const float* x, const float* y, const float* z,
+	float* vx, float* vy, float* vz,
+	size_t count, float center[], float radius);
+
+// same with a fixed instruction set, levels above simd_level() fall back to simd_level()
+void velocity_field_batch(
+	SimdLevel level,
+	const float* x, const float* y, const float* z,
+	float* vx, float* vy, float* vz,
+	size_t count, float center[], float radius);
@@ -0,0 +1,25 @@
+// batch velocity field for AVX2, only called by curl_noise_batch.cpp after checking the cpu supports it
+// standard headers come first so none of their inline functions get compiled for AVX2
+#include <cmath>
+#include <cstddef>
+
+#if defined(_M_X64) || defined(_M_IX86) || defined(__x86_64__) || defined(__i386__)
+#if defined(__clang__)
+#pragma clang attribute push (__attribute__((target("avx2,fma"))), apply_to = function)
+#elif defined(__GNUC__)
+#pragma GCC target("avx2,fma")
+#endif
+
+#define CURL_NOISE_SIMD_AVX2
+#include "simd.h"
+#include "curl_noise_lanes.h"
+
+void velocity_field_batch_avx2(const float* x, const float* y, const float* z, float* vx, float* vy, float* vz, size_t count, const float center[], float radius)
+{
+	velocity_field_batch_lanes<float_avx2>(x, y, z, vx, vy, vz, count, center, radius);
+}
+
+#if defined(__clang__)
+#pragma clang attribute pop
+#endif
+#endif
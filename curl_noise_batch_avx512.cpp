@@ -0,0 +1,31 @@
+// batch velocity field for AVX512, only called by curl_noise_batch.cpp after checking the cpu supports it
+// standard headers come first so none of their inline functions get compiled for AVX512
+#include <cmath>
+#include <cstddef>
+
+#if defined(_M_X64) || defined(_M_IX86) || defined(__x86_64__) || defined(__i386__)
+#if defined(__clang__)
+#pragma clang attribute push (__attribute__((target("avx512f"))), apply_to = function)
+#elif defined(__GNUC__)
+#pragma GCC target("avx512f")
+// gcc 12 flags __Y = __Y in the _mm512_sqrt_ps and _mm512_div_ps wrappers of avx512fintrin.h, a known false positive
+#pragma GCC diagnostic push
+#pragma GCC diagnostic ignored "-Wuninitialized"
+#pragma GCC diagnostic ignored "-Wmaybe-uninitialized"
+#endif
+
+#define CURL_NOISE_SIMD_AVX512
+#include "simd.h"
+#include "curl_noise_lanes.h"
+
+void velocity_field_batch_avx512(const float* x, const float* y, const float* z, float* vx, float* vy, float* vz, size_t count, const float center[], float radius)
+{
+	velocity_field_batch_lanes<float_avx512>(x, y, z, vx, vy, vz, count, center, radius);
+}
+
+#if defined(__clang__)
+#pragma clang attribute pop
+#elif defined(__GNUC__)
+#pragma GCC diagnostic pop
+#endif
+#endif
@@ -0,0 +1,380 @@
+#pragma once
+// the one implementation of the curl noise primitives, templated on the lane type V
+// V is float for the fast scalar path, double for the reference path or one of the register types of simd.h for the batch path,
+// so the type fixes both the precision and the number of points evaluated at once
+// branches on the position become masks and selects, branches that only depend on radius stay scalar because radius is
+// the same for every lane, primitive parameters are floats and broadcast into V
+// curl_noise.h wraps these for the float[] and glm::vec3 interfaces
+#include <cmath>
+#include <cstddef>
+
+template <typename V>
+inline V lanes_dot(const V a[], const V b[])
+{
+	return a[0] * b[0] + a[1] * b[1] + a[2] * b[2];
+}
+
+// smoothstep(1.0, 1.5, dist), where the occluder fades into the field
+template <typename V>
+inline V occluder_blend(V dist, V* derivative)
+{
+	V t = simd_min(simd_max((dist - V(1.0f)) * V(2.0f), V(0.0f)), V(1.0f));
+	if (derivative) *derivative = simd_select((t > V(0.0f)) & (t < V(1.0f)), V(12.0f) * t * (V(1.0f) - t), V(0.0f));
+	return t * t * (V(3.0f) - V(2.0f) * t);
+}
+
+// removes the potential component along the surface normal near the ellipsoid and zeroes it inside
+template <typename V>
+inline void potential_occluder_lanes(
+	const float p[],      // center of occluder
+	const float radius[], // radii of ellipsoid occluder
+	const V phi[],        // potential so far
+	const V x[],
+	V nphi[])
+{
+	V local_x[3];
+	for (int k = 0; k < 3; k++) local_x[k] = (x[k] - V(p[k])) / V(radius[k]);
+	V dist = simd_sqrt(lanes_dot(local_x, local_x));
+	auto inside = dist < V(1.0f);
+	if (simd_all(inside))
+	{
+		for (int i = 0; i < 3; i++) nphi[i] = V(0.0f);
+		return;
+	}
+	V inv_len = V(1.0f) / simd_sqrt(lanes_dot(x, x));
+	V n[3];
+	for (int k = 0; k < 3; k++) n[k] = x[k] * inv_len;
+	V alpha = occluder_blend(dist, static_cast<V*>(nullptr));
+	V dot = lanes_dot(n, phi);
+	for (int i = 0; i < 3; i++) nphi[i] = simd_select(inside, V(0.0f), (V(1.0f) - alpha) * n[i] * dot + phi[i] * alpha);
+}
+
+template <typename V>
+inline void potential_occluder_jacobian_lanes(
+	const float p[],      // center of occluder
+	const float radius[], // radii of ellipsoid occluder
+	const V phi[],        // potential so far
+	const V jphi[3][3],   // jacobian of potential so far
+	const V x[],
+	V nphi[],
+	V jac[3][3])
+{
+	V local_x[3];
+	for (int k = 0; k < 3; k++) local_x[k] = (x[k] - V(p[k])) / V(radius[k]);
+	V dist = simd_sqrt(lanes_dot(local_x, local_x));
+	auto inside = dist < V(1.0f);
+	// nothing to blend when every lane is inside
+	if (simd_all(inside))
+	{
+		for (int i = 0; i < 3; i++)
+		{
+			nphi[i] = V(0.0f);
+			for (int j = 0; j < 3; j++) jac[i][j] = V(0.0f);
+		}
+		return;
+	}
+	V inv_len = V(1.0f) / simd_sqrt(lanes_dot(x, x));
+	V n[3];
+	for (int k = 0; k < 3; k++) n[k] = x[k] * inv_len;
+	V dalpha;
+	V alpha = occluder_blend(dist, &dalpha);
+	V dot = lanes_dot(n, phi);
+	// d alpha / d x_j
+	V grad_alpha[3];
+	for (int j = 0; j < 3; j++) grad_alpha[j] = dalpha * local_x[j] / (dist * V(radius[j]));
+	// d (n . phi) / d x_j with d n_i / d x_j = (delta_ij - n_i n_j) / |x|
+	V grad_dot[3];
+	for (int j = 0; j < 3; j++)
+	{
+		grad_dot[j] = (phi[j] - n[j] * dot) * inv_len;
+		for (int k = 0; k < 3; k++) grad_dot[j] = grad_dot[j] + n[k] * jphi[k][j];
+	}
+	for (int i = 0; i < 3; i++)
+	{
+		nphi[i] = simd_select(inside, V(0.0f), (V(1.0f) - alpha) * n[i] * dot + phi[i] * alpha);
+		for (int j = 0; j < 3; j++)
+		{
+			V dn = (V(i == j ? 1.0f : 0.0f) - n[i] * n[j]) * inv_len;
+			V d = grad_alpha[j] * (phi[i] - n[i] * dot)
+				+ (V(1.0f) - alpha) * (dn * dot + n[i] * grad_dot[j])
+				+ alpha * jphi[i][j];
+			jac[i][j] = simd_select(inside, V(0.0f), d);
+		}
+	}
+}
+
+// f(|x - x_c|/R) (R*R - ||x-x_c||^2)/2 omega_c
+// where f: smoothing kernel
+template <typename V>
+inline void potential_vortex_lanes(
+	float R,           // radius of influence
+	const V x_c[],     // center point of vortex
+	const V omega_c[], // angular velocity of vortex
+	const V x[],
+	V vec[])
+{
+	V dist[3];
+	for (int k = 0; k < 3; k++) dist[k] = x[k] - x_c[k];
+	V len2 = lanes_dot(dist, dist);
+	V f = simd_min(simd_max(V(1.0f) - simd_sqrt(len2) / V(R), V(0.0f)), V(1.0f));
+	V s = f * (V(R * R) - len2) * V(0.5f);
+	for (int k = 0; k < 3; k++) vec[k] = omega_c[k] * s;
+}
+
+template <typename V>
+inline void potential_vortex_jacobian_lanes(
+	float R,           // radius of influence
+	const V x_c[],     // center point of vortex
+	const V omega_c[], // angular velocity of vortex
+	const V x[],
+	V vec[],
+	V jac[3][3],
+	const V (*dx_c)[3] = nullptr,     // jacobian of x_c, nullptr if constant
+	const V (*domega_c)[3] = nullptr) // jacobian of omega_c, nullptr if constant
+{
+	V dist[3];
+	for (int k = 0; k < 3; k++) dist[k] = x[k] - x_c[k];
+	V len2 = lanes_dot(dist, dist);
+	V len = simd_sqrt(len2);
+	V f = simd_min(simd_max(V(1.0f) - len / V(R), V(0.0f)), V(1.0f));
+	V g = (V(R * R) - len2) * V(0.5f);
+	V s = f * g;
+	// d s / d dist, the kernel is only differentiable inside of the clamp
+	V df = simd_select((len > V(0.0f)) & (len < V(R)), V(-1.0f) / (V(R) * len), V(0.0f));
+	V grad_s[3];
+	for (int k = 0; k < 3; k++) grad_s[k] = (df * g - f) * dist[k];
+	// chain rule through dist = x - x_c
+	V ds[3];
+	for (int j = 0; j < 3; j++)
+	{
+		ds[j] = grad_s[j];
+		if (dx_c)
+		{
+			for (int k = 0; k < 3; k++) ds[j] = ds[j] - grad_s[k] * dx_c[k][j];
+		}
+	}
+	for (int i = 0; i < 3; i++)
+	{
+		vec[i] = omega_c[i] * s;
+		for (int j = 0; j < 3; j++)
+		{
+			jac[i][j] = omega_c[i] * ds[j];
+			if (domega_c) jac[i][j] = jac[i][j] + domega_c[i][j] * s;
+		}
+	}
+}
+
+// closest point x_c on the ring and the normalised direction d from its center, omega_c = 2 * (n x d)
+template <typename V>
+inline V ring_closest_point(float r, const float c[], const float n[], const V x[], V d[], V x_c[], V omega_c[])
+{
+	for (int k = 0; k < 3; k++) d[k] = x[k] - V(c[k]);
+	V dot = d[0] * V(n[0]) + d[1] * V(n[1]) + d[2] * V(n[2]);
+	for (int k = 0; k < 3; k++) d[k] = d[k] - V(n[k]) * dot;
+	V inv_len = V(1.0f) / simd_sqrt(lanes_dot(d, d));
+	for (int k = 0; k < 3; k++) d[k] = d[k] * inv_len;
+	for (int k = 0; k < 3; k++) x_c[k] = d[k] * V(r) + V(c[k]);
+	omega_c[0] = (V(n[1]) * d[2] - V(n[2]) * d[1]) * V(2.0f);
+	omega_c[1] = (V(n[2]) * d[0] - V(n[0]) * d[2]) * V(2.0f);
+	omega_c[2] = (V(n[0]) * d[1] - V(n[1]) * d[0]) * V(2.0f);
+	return inv_len;
+}
+
+// a vortex whose center and axis follow the closest point on a circle
+template <typename V>
+inline void potential_vortex_ring_lanes(
+	float R,         // radius of vortex around ring
+	float r,         // radius of ring itself
+	const float c[], // center of ring
+	const float n[], // normal of ring
+	const V x[],     // point to evaluate
+	V vec[])
+{
+	V d[3];
+	V x_c[3];
+	V omega_c[3];
+	ring_closest_point(r, c, n, x, d, x_c, omega_c);
+	potential_vortex_lanes(R, x_c, omega_c, x, vec);
+}
+
+template <typename V>
+inline void potential_vortex_ring_jacobian_lanes(
+	float R,         // radius of vortex around ring
+	float r,         // radius of ring itself
+	const float c[], // center of ring
+	const float n[], // normal of ring
+	const V x[],     // point to evaluate
+	V vec[],
+	V jac[3][3])
+{
+	V d[3];
+	V x_c[3];
+	V omega_c[3];
+	V inv_len = ring_closest_point(r, c, n, x, d, x_c, omega_c);
+	// derivative of the normalised projection: (I - n n^T - d d^T) / |projection|
+	V du[3][3];
+	for (int i = 0; i < 3; i++)
+	{
+		for (int j = 0; j < 3; j++) du[i][j] = (V((i == j ? 1.0f : 0.0f) - n[i] * n[j]) - d[i] * d[j]) * inv_len;
+	}
+	V dx_c[3][3];
+	for (int i = 0; i < 3; i++)
+	{
+		for (int j = 0; j < 3; j++) dx_c[i][j] = du[i][j] * V(r);
+	}
+	// omega_c is linear in d so the same cross product gives its jacobian
+	V domega_c[3][3];
+	for (int j = 0; j < 3; j++)
+	{
+		domega_c[0][j] = (V(n[1]) * du[2][j] - V(n[2]) * du[1][j]) * V(2.0f);
+		domega_c[1][j] = (V(n[2]) * du[0][j] - V(n[0]) * du[2][j]) * V(2.0f);
+		domega_c[2][j] = (V(n[0]) * du[1][j] - V(n[1]) * du[0][j]) * V(2.0f);
+	}
+	potential_vortex_jacobian_lanes(R, x_c, omega_c, x, vec, jac, dx_c, domega_c);
+}
+
+// the helicopter: downwash rotation, main rotor vortex ring, a second ring once radius passes the rotor, and the fuselage
+template <typename V>
+inline void potential_field_lanes(const V x[], V potential[], const float center[], float radius)
+{
+	float radius_function = -fabsf(radius - 5.95f) + 5.95f;
+	// rotation of downwash:
+	V c[3] = { V(center[0]), V(center[1]), V(center[2]) };
+	V av[3] = { V(0.0f), V(-0.5f), V(0.0f) }; // angular velocity
+	V phi[3];
+	potential_vortex_lanes(5.95f, c, av, x, phi);
+	float axis[3] = { 0.0f, 1.0f, 0.0f };
+	// vortex ring of main rotor
+	V vec[3];
+	potential_vortex_ring_lanes(radius_function, 5.95f, center, axis, x, vec);
+	for (int k = 0; k < 3; k++) phi[k] = phi[k] + vec[k];
+	// second vortex ring, starts after first vortex ring covers the whole main rotor
+	if (radius > 5.95f)
+	{
+		axis[1] = -1.0f;
+		potential_vortex_ring_lanes(5.95f - radius_function, 5.95f - radius_function, center, axis, x, vec);
+		for (int k = 0; k < 3; k++) phi[k] = phi[k] + vec[k];
+	}
+	// fuselage
+	const float com[3] = { 0.0f, -1.6f, 0.0f }; // center of mass
+	const float occluder_radius[3] = { 1.0f, 1.6f, 4.5f };
+	potential_occluder_lanes(com, occluder_radius, phi, x, potential);
+}
+
+// same field as potential_field_lanes, additionally returns its jacobian
+template <typename V>
+inline void potential_field_jacobian_lanes(const V x[], V potential[], V jac[3][3], const float center[], float radius)
+{
+	float radius_function = -fabsf(radius - 5.95f) + 5.95f;
+	// rotation of downwash:
+	V c[3] = { V(center[0]), V(center[1]), V(center[2]) };
+	V av[3] = { V(0.0f), V(-0.5f), V(0.0f) }; // angular velocity
+	V phi[3];
+	V jphi[3][3];
+	potential_vortex_jacobian_lanes(5.95f, c, av, x, phi, jphi);
+	float axis[3] = { 0.0f, 1.0f, 0.0f };
+	// vortex ring of main rotor
+	V vec[3];
+	V jvec[3][3];
+	potential_vortex_ring_jacobian_lanes(radius_function, 5.95f, center, axis, x, vec, jvec);
+	for (int i = 0; i < 3; i++)
+	{
+		phi[i] = phi[i] + vec[i];
+		for (int j = 0; j < 3; j++) jphi[i][j] = jphi[i][j] + jvec[i][j];
+	}
+	// second vortex ring, starts after first vortex ring covers the whole main rotor
+	if (radius > 5.95f)
+	{
+		axis[1] = -1.0f;
+		potential_vortex_ring_jacobian_lanes(5.95f - radius_function, 5.95f - radius_function, center, axis, x, vec, jvec);
+		for (int i = 0; i < 3; i++)
+		{
+			phi[i] = phi[i] + vec[i];
+			for (int j = 0; j < 3; j++) jphi[i][j] = jphi[i][j] + jvec[i][j];
+		}
+	}
+	// fuselage
+	const float com[3] = { 0.0f, -1.6f, 0.0f }; // center of mass
+	const float occluder_radius[3] = { 1.0f, 1.6f, 4.5f };
+	potential_occluder_jacobian_lanes(com, occluder_radius, phi, jphi, x, potential, jac);
+}
+
+// d potential / d x_j by forward differences, with the sign of potential_deriv: (p(x) - p(x + eps)) / eps
+template <typename V>
+inline void potential_deriv_lanes(const V x[], V dpdx[], V dpdy[], V dpdz[], const float center[], float radius, float eps = 1e-4f)
+{
+	V c[3];
+	potential_field_lanes(x, c, center, radius);
+	V* derivatives[3] = { dpdx, dpdy, dpdz };
+	for (int j = 0; j < 3; j++)
+	{
+		V shifted[3] = { x[0], x[1], x[2] };
+		shifted[j] = shifted[j] + V(eps);
+		V potential[3];
+		potential_field_lanes(shifted, potential, center, radius);
+		for (int k = 0; k < 3; k++) derivatives[j][k] = (c[k] - potential[k]) / V(eps);
+	}
+}
+
+// curl of the finite difference derivatives, 4 potential evaluations
+template <typename V>
+inline void velocity_field_fd_lanes(const V x[], V vec[], const float center[], float radius)
+{
+	V dpdx[3], dpdy[3], dpdz[3];
+	potential_deriv_lanes(x, dpdx, dpdy, dpdz, center, radius);
+	vec[0] = dpdy[2] - dpdz[1];
+	vec[1] = dpdz[0] - dpdx[2];
+	vec[2] = dpdx[1] - dpdy[0];
+}
+
+// curl of the analytic jacobian, same sign convention as velocity_field_fd_lanes
+template <typename V>
+inline void velocity_field_lanes(const V x[], V vec[], const float center[], float radius)
+{
+	V potential[3];
+	V jac[3][3];
+	potential_field_jacobian_lanes(x, potential, jac, center, radius);
+	vec[0] = jac[1][2] - jac[2][1];
+	vec[1] = jac[2][0] - jac[0][2];
+	vec[2] = jac[0][1] - jac[1][0];
+}
+
+template <typename V>
+inline void velocity_field_batch_lanes(
+	const float* x, const float* y, const float* z,
+	float* vx, float* vy, float* vz,
+	size_t count, const float center[], float radius)
+{
+	size_t i = 0;
+	for (; i + V::width <= count; i += V::width)
+	{
+		V p[3] = { V::load(x + i), V::load(y + i), V::load(z + i) };
+		V v[3];
+		velocity_field_lanes(p, v, center, radius);
+		v[0].store(vx + i);
+		v[1].store(vy + i);
+		v[2].store(vz + i);
+	}
+	if (i < count)
+	{
+		// pad the tail with its last point so every lane holds a valid position
+		float tail[3][V::width];
+		for (int l = 0; l < V::width; l++)
+		{
+			size_t index = (i + l < count) ? i + l : count - 1;
+			tail[0][l] = x[index];
+			tail[1][l] = y[index];
+			tail[2][l] = z[index];
+		}
+		V p[3] = { V::load(tail[0]), V::load(tail[1]), V::load(tail[2]) };
+		V v[3];
+		velocity_field_lanes(p, v, center, radius);
+		for (int k = 0; k < 3; k++) v[k].store(tail[k]);
+		for (size_t l = 0; i + l < count; l++)
+		{
+			vx[i + l] = tail[0][l];
+			vy[i + l] = tail[1][l];
+			vz[i + l] = tail[2][l];
+		}
+	}
+}
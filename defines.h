@@ -17,4 +17,43 @@ struct Vertex
 	glm::vec3 position;
 	glm::vec4 color;
 	glm::vec3 normal;
-};
\ No newline at end of file
+};
+
+// tracer line point, the shader turns parameter (0 oldest, 1 head) into the blue to red gradient
+struct TracerVertex
+{
+	glm::vec3 position;
+	float parameter;
+};
+
+// model vertex as stored in .bmf files, the color comes from the material
+struct ModelVertex
+{
+	glm::vec3 position;
+	glm::vec3 normal;
+};
+
+struct Material
+{
+	glm::vec3 diffuse;
+	glm::vec3 specular;
+	glm::vec3 emissive;
+	float shininess;
+};
+
+enum class VertexLayout
+{
+	Basic,  // Vertex
+	Tracer, // TracerVertex
+	Model   // ModelVertex, attribute 1 is left to a constant color
+};
+
+inline uint32 vertex_stride(VertexLayout layout)
+{
+	switch (layout)
+	{
+	case VertexLayout::Tracer: return sizeof(TracerVertex);
+	case VertexLayout::Model: return sizeof(ModelVertex);
+	default: return sizeof(Vertex);
+	}
+}
\ No newline at end of file
@@ -0,0 +1,490 @@
+// golden output check of every velocity field backend, the golden field is the curl of the double precision potential
+// by central differences, so it shares none of the jacobian code the backends and the analytic reference run through
+// samples a dense jittered lattice and the points of reference streamlines for several radii, leaves out the points
+// next to the vortex cores and ring axes where the field isn't smooth, reports the max and rms error and the numerical
+// divergence per backend and exits with 1 if any bound is exceeded
+// build it with the optimization flags of the application, so a flag that breaks a kernel shows up here, and together
+// with curl_noise_batch.cpp, curl_noise_batch_avx2.cpp and curl_noise_batch_avx512.cpp
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <functional>
+#include <iostream>
+#include <sstream>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "defines.h"
+#include "curl_noise.h"
+#include "curl_noise_batch.h"
+#include "field_scene.h"
+#include "thread_pool.h"
+#include "velocity_grid.h"
+
+static void print_usage()
+{
+	std::cout << "usage: field_check [options]\n"
+		<< "  -r radii      comma separated vortex ring radii (2.5,5.95,9)\n"
+		<< "  -n res        dense lattice points along x and z, y gets three quarters (48)\n"
+		<< "  -s seeds      reference streamline seeds along each side of the tracing volume (8)\n"
+		<< "  -c distance   leaves out points closer than this to a vortex center, ring, ring axis or occluder, the bounds are set for 0.75 (0.75)\n"
+		<< "  -b scale      multiplies every bound, below 1 to tighten them (1)\n";
+}
+
+// points as separate x/y/z arrays, the layout the batch kernels take
+struct SamplePoints
+{
+	std::vector<float> x;
+	std::vector<float> y;
+	std::vector<float> z;
+
+	void push_back(double px, double py, double pz)
+	{
+		x.push_back(static_cast<float>(px));
+		y.push_back(static_cast<float>(py));
+		z.push_back(static_cast<float>(pz));
+	}
+
+	size_t size() const
+	{
+		return x.size();
+	}
+};
+
+typedef std::function<void(const SamplePoints&, std::vector<double>[3])> Field;
+typedef std::function<void(const double[], double[])> ReferenceField;
+
+// one backend and what it may deviate from the reference, errors and divergence are relative to
+// max(1, |golden velocity|) like velocity_field_matches_fd
+struct Backend
+{
+	std::string name;
+	bool scene;              // compared to the golden scene field, the golden helicopter field otherwise
+	float max_error;
+	float rms_error;
+	float max_divergence;
+	Field field;
+};
+
+struct Statistics
+{
+	size_t samples = 0;
+	size_t nonfinite = 0; // backend results that are nan or inf where the reference is finite
+	double max_error = 0.0;
+	double sum_error2 = 0.0;
+	double max_divergence = 0.0;
+	double sum_divergence2 = 0.0;
+
+	double rms_error() const
+	{
+		return samples ? sqrt(sum_error2 / samples) : 0.0;
+	}
+
+	double rms_divergence() const
+	{
+		return samples ? sqrt(sum_divergence2 / samples) : 0.0;
+	}
+};
+
+// central difference step of the divergence, small against the field's features and large against float rounding
+const float DIVERGENCE_STEP = 1e-3f;
+// the velocity has a kink at the edge of every vortex's influence and where the occluder blend ends, central differences
+// straddling one aren't divergence free, points this close to one are left out
+const double KINK_DISTANCE = 1e-2;
+// velocity_field_matches_fd tolerance, about 4x the worst mismatch, the finite differences in float are the less accurate side by far
+const float FD_TOLERANCE = 2e-1f;
+// central difference step of the golden curl, in double both its truncation and rounding error stay below 1e-8
+const double CURL_STEP = 1e-5;
+
+// tests the exponent bits, std::isfinite is folded to true under -ffast-math and this check has to survive it
+static bool is_finite(double v)
+{
+	uint64 bits;
+	memcpy(&bits, &v, sizeof(bits));
+	return (bits & 0x7FF0000000000000ull) != 0x7FF0000000000000ull;
+}
+
+// the same integer hash for every run, so the lattice jitter never changes between builds
+static double jitter(uint32 i, uint32 k)
+{
+	uint32 h = i * 2654435761u ^ (k + 1) * 2246822519u;
+	h ^= h >> 15;
+	h *= 2246822519u;
+	h ^= h >> 13;
+	return (h & 0xFFFF) / 65535.0 - 0.5;
+}
+
+// the baked grid domain with a little margin, jittered by up to half a cell so no point sits on a grid node
+static SamplePoints dense_points(int res)
+{
+	const double min[3] = { -13.0, -13.0, -13.0 };
+	const double max[3] = { 13.0, 7.0, 13.0 };
+	const int counts[3] = { res, std::max(2, res * 3 / 4), res };
+	SamplePoints points;
+	uint32 i = 0;
+	for (int z = 0; z < counts[2]; z++)
+	{
+		for (int y = 0; y < counts[1]; y++)
+		{
+			for (int x = 0; x < counts[0]; x++, i++)
+			{
+				int index[3] = { x, y, z };
+				double p[3];
+				for (int k = 0; k < 3; k++)
+				{
+					double cell = (max[k] - min[k]) / (counts[k] - 1);
+					p[k] = min[k] + (index[k] + jitter(i, k)) * cell;
+				}
+				points.push_back(p[0], p[1], p[2]);
+			}
+		}
+	}
+	return points;
+}
+
+// rk4 in double through the reference field from seeds in the tracing volume, every third point is a sample
+static SamplePoints streamline_points(const ReferenceField& reference, int seeds)
+{
+	const double tracing_width = 15.0;
+	const double tracing_height = 8.0;
+	const double dt = 0.01;
+	const int steps = 300;
+	SamplePoints points;
+	for (int i = 0; i < seeds; i++)
+	{
+		for (int j = 0; j < seeds; j++)
+		{
+			for (int k = 0; k < seeds; k++)
+			{
+				double p[3] = { tracing_width / 2.0 - (i + 0.5) * tracing_width / seeds,
+					tracing_height / 2.0 - (k + 0.5) * tracing_height / seeds,
+					tracing_width / 2.0 - (j + 0.5) * tracing_width / seeds };
+				for (int s = 0; s < steps; s++)
+				{
+					double k1[3], k2[3], k3[3], k4[3], q[3];
+					reference(p, k1);
+					for (int c = 0; c < 3; c++) q[c] = p[c] + 0.5 * dt * k1[c];
+					reference(q, k2);
+					for (int c = 0; c < 3; c++) q[c] = p[c] + 0.5 * dt * k2[c];
+					reference(q, k3);
+					for (int c = 0; c < 3; c++) q[c] = p[c] + dt * k3[c];
+					reference(q, k4);
+					for (int c = 0; c < 3; c++) p[c] += dt / 6.0 * (k1[c] + 2.0 * k2[c] + 2.0 * k3[c] + k4[c]);
+					if (!is_finite(p[0] + p[1] + p[2])) break;
+					if (s % 3 == 2) points.push_back(p[0], p[1], p[2]);
+				}
+			}
+		}
+	}
+	return points;
+}
+
+// the sample points moved by +-DIVERGENCE_STEP along one axis, in the order -x +x -y +y -z +z
+static std::vector<SamplePoints> divergence_points(const SamplePoints& points)
+{
+	std::vector<SamplePoints> shifted(6, points);
+	for (int axis = 0; axis < 3; axis++)
+	{
+		for (int side = 0; side < 2; side++)
+		{
+			SamplePoints& s = shifted[axis * 2 + side];
+			std::vector<float>& c = axis == 0 ? s.x : axis == 1 ? s.y : s.z;
+			for (float& v : c) v += side ? DIVERGENCE_STEP : -DIVERGENCE_STEP;
+		}
+	}
+	return shifted;
+}
+
+// the reference at the float sample positions, the backends see exactly the same points
+static void reference_velocities(const ReferenceField& reference, const SamplePoints& points, std::vector<double> out[3])
+{
+	for (int k = 0; k < 3; k++) out[k].resize(points.size());
+	for (size_t i = 0; i < points.size(); i++)
+	{
+		double x[3] = { points.x[i], points.y[i], points.z[i] };
+		double v[3];
+		reference(x, v);
+		for (int k = 0; k < 3; k++) out[k][i] = v[k];
+	}
+}
+
+// curl of a double potential from central differences, jac[i][j] = d potential_i / d x_j
+static void curl_reference(const ReferenceField& potential, const double x[], double vec[])
+{
+	double jac[3][3];
+	for (int j = 0; j < 3; j++)
+	{
+		double high[3] = { x[0], x[1], x[2] };
+		double low[3] = { x[0], x[1], x[2] };
+		high[j] += CURL_STEP;
+		low[j] -= CURL_STEP;
+		double p_high[3], p_low[3];
+		potential(high, p_high);
+		potential(low, p_low);
+		for (int i = 0; i < 3; i++) jac[i][j] = (p_high[i] - p_low[i]) / (2.0 * CURL_STEP);
+	}
+	vec[0] = jac[1][2] - jac[2][1];
+	vec[1] = jac[2][0] - jac[0][2];
+	vec[2] = jac[0][1] - jac[1][0];
+}
+
+// distance to the nearest place the field isn't smooth: the vortex centers and the ring circles, where the velocity
+// changes direction abruptly, the ring axes, where the closest point on the ring is undefined, and the occluder
+// surfaces, where the potential drops to zero
+// kink is set to the distance to the nearest edge of a vortex's influence or of the occluder blend
+static double core_distance(const CompiledScene& scene, const double x[], double* kink)
+{
+	double distance = 1e30;
+	*kink = 1e30;
+	for (const SceneVortex& v : scene.vortices)
+	{
+		double d[3] = { x[0] - v.center[0], x[1] - v.center[1], x[2] - v.center[2] };
+		double len = sqrt(d[0] * d[0] + d[1] * d[1] + d[2] * d[2]);
+		distance = std::min(distance, len);
+		*kink = std::min(*kink, fabs(len - v.R));
+	}
+	for (const SceneRing& r : scene.rings)
+	{
+		double d[3] = { x[0] - r.center[0], x[1] - r.center[1], x[2] - r.center[2] };
+		double axial = d[0] * r.normal[0] + d[1] * r.normal[1] + d[2] * r.normal[2];
+		double radial2 = std::max(0.0, d[0] * d[0] + d[1] * d[1] + d[2] * d[2] - axial * axial);
+		double radial = sqrt(radial2);
+		distance = std::min(distance, radial);
+		double circle = sqrt((radial - r.r) * (radial - r.r) + axial * axial);
+		distance = std::min(distance, circle);
+		*kink = std::min(*kink, fabs(circle - r.R));
+	}
+	for (const SceneOccluder& o : scene.occluders)
+	{
+		// a lower bound of the distance to the ellipsoid, exact for a sphere
+		double local2 = 0.0;
+		for (int k = 0; k < 3; k++) local2 += (x[k] - o.center[k]) * (x[k] - o.center[k]) / (o.radius[k] * o.radius[k]);
+		double smallest = std::min(o.radius[0], std::min(o.radius[1], o.radius[2]));
+		distance = std::min(distance, fabs(sqrt(local2) - 1.0) * smallest);
+		*kink = std::min(*kink, fabs(sqrt(local2) - 1.5) * smallest);
+	}
+	return distance;
+}
+
+// the points at least margin away from the cores and KINK_DISTANCE from the kinks
+static SamplePoints smooth_points(const SamplePoints& points, const CompiledScene& scene, double margin)
+{
+	SamplePoints smooth;
+	for (size_t i = 0; i < points.size(); i++)
+	{
+		double x[3] = { points.x[i], points.y[i], points.z[i] };
+		double kink;
+		if (core_distance(scene, x, &kink) >= margin && kink >= KINK_DISTANCE) smooth.push_back(x[0], x[1], x[2]);
+	}
+	return smooth;
+}
+
+// the steps are taken in float like the backends do, so the divergence divides by the actual distance
+static double divergence(const std::vector<SamplePoints>& shifted, const std::vector<double> (*velocities)[3], size_t i)
+{
+	double div = 0.0;
+	for (int axis = 0; axis < 3; axis++)
+	{
+		const std::vector<float>& low = axis == 0 ? shifted[axis * 2].x : axis == 1 ? shifted[axis * 2].y : shifted[axis * 2].z;
+		const std::vector<float>& high = axis == 0 ? shifted[axis * 2 + 1].x : axis == 1 ? shifted[axis * 2 + 1].y : shifted[axis * 2 + 1].z;
+		div += (velocities[axis * 2 + 1][axis][i] - velocities[axis * 2][axis][i]) / (static_cast<double>(high[i]) - low[i]);
+	}
+	return div;
+}
+
+static Statistics compare(const Backend& backend, const SamplePoints& points, const std::vector<SamplePoints>& shifted, const std::vector<double> reference[3])
+{
+	Statistics statistics;
+	std::vector<double> velocity[3];
+	backend.field(points, velocity);
+	std::vector<double> shifted_velocity[6][3];
+	for (int s = 0; s < 6; s++) backend.field(shifted[s], shifted_velocity[s]);
+	for (size_t i = 0; i < points.size(); i++)
+	{
+		double r[3] = { reference[0][i], reference[1][i], reference[2][i] };
+		if (!is_finite(r[0] + r[1] + r[2])) continue;
+		double v[3] = { velocity[0][i], velocity[1][i], velocity[2][i] };
+		double div = divergence(shifted, shifted_velocity, i);
+		if (!is_finite(v[0] + v[1] + v[2] + div))
+		{
+			statistics.nonfinite++;
+			continue;
+		}
+		double error2 = 0.0;
+		for (int k = 0; k < 3; k++) error2 += (v[k] - r[k]) * (v[k] - r[k]);
+		double scale = std::max(1.0, sqrt(r[0] * r[0] + r[1] * r[1] + r[2] * r[2]));
+		double error = sqrt(error2) / scale;
+		div = fabs(div) / scale;
+		statistics.samples++;
+		statistics.max_error = std::max(statistics.max_error, error);
+		statistics.sum_error2 += error * error;
+		statistics.max_divergence = std::max(statistics.max_divergence, div);
+		statistics.sum_divergence2 += div * div;
+	}
+	return statistics;
+}
+
+// a point at a time through one of the float[] kernels
+static Field pointwise(const std::function<void(float[], float[])>& kernel)
+{
+	return [kernel](const SamplePoints& points, std::vector<double> out[3])
+	{
+		for (int k = 0; k < 3; k++) out[k].resize(points.size());
+		for (size_t i = 0; i < points.size(); i++)
+		{
+			float x[3] = { points.x[i], points.y[i], points.z[i] };
+			float v[3] = { 0.0f, 0.0f, 0.0f };
+			kernel(x, v);
+			for (int k = 0; k < 3; k++) out[k][i] = v[k];
+		}
+	};
+}
+
+int main(int argc, char** argv)
+{
+	std::vector<float> radii = { 2.5f, 5.95f, 9.0f };
+	int res = 48;
+	int seeds = 8;
+	double margin = 0.75;
+	float bound_scale = 1.0f;
+	for (int a = 1; a < argc; a++)
+	{
+		if (strcmp(argv[a], "-r") == 0 && a + 1 < argc)
+		{
+			radii.clear();
+			std::stringstream list(argv[++a]);
+			std::string radius;
+			while (std::getline(list, radius, ',')) radii.push_back(static_cast<float>(atof(radius.c_str())));
+		}
+		else if (strcmp(argv[a], "-n") == 0 && a + 1 < argc) res = atoi(argv[++a]);
+		else if (strcmp(argv[a], "-s") == 0 && a + 1 < argc) seeds = atoi(argv[++a]);
+		else if (strcmp(argv[a], "-c") == 0 && a + 1 < argc) margin = atof(argv[++a]);
+		else if (strcmp(argv[a], "-b") == 0 && a + 1 < argc) bound_scale = static_cast<float>(atof(argv[++a]));
+		else
+		{
+			print_usage();
+			return 1;
+		}
+	}
+	if (radii.empty() || res < 2 || seeds < 1 || !(margin >= 0.0) || !(bound_scale > 0.0f))
+	{
+		print_usage();
+		return 1;
+	}
+
+	const FieldScene field_scene = default_scene();
+	ThreadPool thread_pool;
+	// the simulation's keyframes, they bake in the background while the first radii are checked
+	VelocityGridKeyframes keyframes(field_scene, glm::vec3(-12.0f, -12.0f, -12.0f), glm::vec3(12.0f, 6.0f, 12.0f), 65, 49, 65, radius_keyframes(5.95f, 8));
+	keyframes.request(radii.front());
+	const SamplePoints lattice = dense_points(res);
+
+	bool passed = true;
+	printf("%-6s %-10s %-20s %8s %11s %11s %11s %11s  %s\n", "radius", "points", "backend", "samples", "max_error", "rms_error", "max_div", "rms_div", "result");
+	for (float radius : radii)
+	{
+		const float center[3] = { 0.0f, 0.0f, 0.0f };
+		CompiledScene scene;
+		compile_scene(field_scene, radius, &scene);
+		// the helicopter kernels and the default scene are the same field, the streamlines follow either
+		ReferenceField helicopter_reference = [&](const double x[], double v[]) { velocity_field_reference(x, v, center, radius); };
+		ReferenceField scene_reference = [&](const double x[], double v[]) { velocity_field_reference(x, v, scene); };
+		ReferenceField helicopter_potential = [&](const double x[], double p[]) { potential_field_reference(x, p, center, radius); };
+		ReferenceField scene_potential = [&](const double x[], double p[]) { potential_field_reference(x, p, scene); };
+		ReferenceField helicopter_golden = [&](const double x[], double v[]) { curl_reference(helicopter_potential, x, v); };
+		ReferenceField scene_golden = [&](const double x[], double v[]) { curl_reference(scene_potential, x, v); };
+
+		VelocityGrid grid;
+		grid.init(glm::vec3(-12.0f, -12.0f, -12.0f), glm::vec3(12.0f, 6.0f, 12.0f), 97, 73, 97);
+		grid.build(scene, thread_pool);
+		keyframes.request(radius);
+		while (!keyframes.get(radius).isValid()) std::this_thread::sleep_for(std::chrono::milliseconds(10));
+		VelocityGridBlend blend = keyframes.get(radius);
+
+		// bounds are the worst case over the default radii with about 4x headroom, finite differences in float lose about
+		// half the digits and the grids are bounded by their cell size, the trilinear ones aren't divergence free
+		std::vector<Backend> backends;
+		// the analytic jacobians in double, anything wrong in them shows up here and not just as float rounding
+		backends.push_back(Backend{ "velocity_field_ref", false, 2e-9f, 3e-10f, 1e-5f,
+			[&](const SamplePoints& points, std::vector<double> out[3]) { reference_velocities(helicopter_reference, points, out); } });
+		backends.push_back(Backend{ "scene_ref", true, 2e-9f, 3e-10f, 1e-5f,
+			[&](const SamplePoints& points, std::vector<double> out[3]) { reference_velocities(scene_reference, points, out); } });
+		backends.push_back(Backend{ "velocity_field", false, 2e-5f, 1.5e-6f, 8e-3f,
+			pointwise([&](float x[], float v[]) { velocity_field(x, v, center, radius); }) });
+		backends.push_back(Backend{ "velocity_field_fd", false, 2.5e-1f, 2.5e-2f, 80.0f,
+			pointwise([&](float x[], float v[]) { velocity_field_fd(x, v, center, radius); }) });
+		for (int level = static_cast<int>(SimdLevel::Scalar); level <= static_cast<int>(simd_level()); level++)
+		{
+			SimdLevel simd = static_cast<SimdLevel>(level);
+			backends.push_back(Backend{ std::string("batch_") + simd_level_name(simd), false, 2e-5f, 1.5e-6f, 8e-3f,
+				[&, simd](const SamplePoints& points, std::vector<double> out[3])
+				{
+					std::vector<float> v[3];
+					for (int k = 0; k < 3; k++) v[k].resize(points.size());
+					float c[3] = { center[0], center[1], center[2] };
+					velocity_field_batch(simd, points.x.data(), points.y.data(), points.z.data(), v[0].data(), v[1].data(), v[2].data(), points.size(), c, radius);
+					for (int k = 0; k < 3; k++) out[k].assign(v[k].begin(), v[k].end());
+				} });
+		}
+		backends.push_back(Backend{ "scene", true, 2e-5f, 1.5e-6f, 8e-3f,
+			pointwise([&](float x[], float v[]) { velocity_field(x, v, scene); }) });
+		backends.push_back(Backend{ "grid_trilinear", true, 1.0f, 8e-2f, 8.0f,
+			pointwise([&](float x[], float v[]) { velocity_field_cached(x, v, scene, VelocityGridBlend(&grid), GridInterpolation::Trilinear); }) });
+		backends.push_back(Backend{ "grid_tricubic", true, 1.5f, 1.5e-1f, 1.5e-1f,
+			pointwise([&](float x[], float v[]) { velocity_field_cached(x, v, scene, VelocityGridBlend(&grid), GridInterpolation::Tricubic); }) });
+		backends.push_back(Backend{ "keyframes_trilinear", true, 2.5f, 8e-1f, 8.0f,
+			pointwise([&](float x[], float v[]) { velocity_field_cached(x, v, scene, blend, GridInterpolation::Trilinear); }) });
+		backends.push_back(Backend{ "keyframes_tricubic", true, 2.5f, 8e-1f, 1.5e-1f,
+			pointwise([&](float x[], float v[]) { velocity_field_cached(x, v, scene, blend, GridInterpolation::Tricubic); }) });
+
+		// the margin also covers the divergence steps, they are far smaller than any sensible margin
+		const SamplePoints dense = smooth_points(lattice, scene, margin);
+		const std::vector<SamplePoints> dense_shifted = divergence_points(dense);
+		const SamplePoints streamlines = smooth_points(streamline_points(helicopter_reference, seeds), scene, margin);
+		const std::vector<SamplePoints> streamlines_shifted = divergence_points(streamlines);
+		const SamplePoints* sets[2] = { &dense, &streamlines };
+		const std::vector<SamplePoints>* shifted_sets[2] = { &dense_shifted, &streamlines_shifted };
+		const char* set_names[2] = { "dense", "streamline" };
+		for (int set = 0; set < 2; set++)
+		{
+			std::vector<double> helicopter[3];
+			std::vector<double> scene_velocity[3];
+			reference_velocities(helicopter_golden, *sets[set], helicopter);
+			reference_velocities(scene_golden, *sets[set], scene_velocity);
+			for (const Backend& backend : backends)
+			{
+				Statistics s = compare(backend, *sets[set], *shifted_sets[set], backend.scene ? scene_velocity : helicopter);
+				bool ok = s.nonfinite == 0 && s.max_error <= backend.max_error * bound_scale && s.rms_error() <= backend.rms_error * bound_scale
+					&& s.max_divergence <= backend.max_divergence * bound_scale;
+				passed = passed && ok;
+				printf("%-6.2f %-10s %-20s %8zu %11.3e %11.3e %11.3e %11.3e  %s", radius, set_names[set], backend.name.c_str(), s.samples,
+					s.max_error, s.rms_error(), s.max_divergence, s.rms_divergence(), ok ? "ok" : "FAILED");
+				if (s.nonfinite) printf(" (%zu nan or inf)", s.nonfinite);
+				printf("\n");
+			}
+			// the analytic path against the finite differences it replaced, the check the simulation can run on its own
+			size_t mismatches = 0;
+			double max_mismatch = 0.0;
+			double sum_mismatch2 = 0.0;
+			for (size_t i = 0; i < sets[set]->size(); i++)
+			{
+				float x[3] = { sets[set]->x[i], sets[set]->y[i], sets[set]->z[i] };
+				float mismatch;
+				if (!velocity_field_matches_fd(x, center, radius, FD_TOLERANCE * bound_scale, &mismatch)) mismatches++;
+				max_mismatch = std::max(max_mismatch, static_cast<double>(mismatch));
+				sum_mismatch2 += static_cast<double>(mismatch) * mismatch;
+			}
+			passed = passed && mismatches == 0;
+			printf("%-6.2f %-10s %-20s %8zu %11.3e %11.3e %11s %11s  %s", radius, set_names[set], "matches_fd", sets[set]->size(), max_mismatch,
+				sets[set]->size() ? sqrt(sum_mismatch2 / sets[set]->size()) : 0.0, "-", "-", mismatches == 0 ? "ok" : "FAILED");
+			if (mismatches) printf(" (%zu beyond %g)", mismatches, FD_TOLERANCE * bound_scale);
+			printf("\n");
+		}
+	}
+	printf(passed ? "all backends within bounds\n" : "some backends exceed their bounds\n");
+	return passed ? 0 : 1;
+}
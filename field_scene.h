@@ -0,0 +1,506 @@
+#pragma once
+#include <algorithm>
+#include <cmath>
+#include <fstream>
+#include <iostream>
+#include <sstream>
+#include <string>
+#include <vector>
+
+#include "defines.h"
+#include "curl_noise.h"
+
+// the primitives of a curl noise field, loaded from a scene file and compiled into flat arrays per primitive type
+// the compiled arrays are what the field loops over, nothing is set up per call
+
+struct SceneVortex
+{
+	float R;         // radius of influence
+	float center[3];
+	float omega[3];  // angular velocity
+};
+
+struct SceneRing
+{
+	float R;         // radius of vortex around ring
+	float r;         // radius of ring itself
+	float center[3];
+	float normal[3];
+};
+
+// rotor wake driven by the simulation radius, compiles to a ring of rotor radius r whose core grows with the radius
+// and shrinks again past r, then a second opposite ring below it
+struct SceneRotor
+{
+	float r;
+	float center[3];
+	float normal[3];
+};
+
+// ellipsoid, the field is blended to zero towards its surface
+struct SceneOccluder
+{
+	float center[3];
+	float radius[3];
+};
+
+struct FieldScene
+{
+	std::vector<SceneVortex> vortices;
+	std::vector<SceneRing> rings;
+	std::vector<SceneRotor> rotors;
+	std::vector<SceneOccluder> occluders;
+};
+
+// uniform grid over the support of the primitives, every cell lists the primitives overlapping it
+// an entry is the primitive type in the top two bits and its index below, sorted so the occluders come last
+struct SceneIndex
+{
+	float min[3] = { 0.0f, 0.0f, 0.0f };
+	float inv_cell = 1.0f;
+	int res[3] = { 0, 0, 0 };
+	std::vector<uint32> cell_start; // res[0] * res[1] * res[2] + 1 offsets into entries
+	std::vector<uint32> entries;
+};
+
+enum : uint32
+{
+	SCENE_VORTEX = 0u << 30,
+	SCENE_RING = 1u << 30,
+	SCENE_OCCLUDER = 2u << 30,
+	SCENE_TYPE_MASK = 3u << 30
+};
+
+// a scene for one simulation radius, rotors are expanded into rings and normals are unit length
+struct CompiledScene
+{
+	float radius = -1.0f;
+	std::vector<SceneVortex> vortices;
+	std::vector<SceneRing> rings;
+	std::vector<SceneOccluder> occluders;
+	SceneIndex index;
+};
+
+// bounds outside of which a primitive leaves the potential untouched
+inline void vortex_support(const SceneVortex& v, float min[], float max[])
+{
+	for (int k = 0; k < 3; k++)
+	{
+		min[k] = v.center[k] - v.R;
+		max[k] = v.center[k] + v.R;
+	}
+}
+
+// the torus swept by the vortex around the ring, n has unit length
+inline void ring_support(const SceneRing& r, float min[], float max[])
+{
+	for (int k = 0; k < 3; k++)
+	{
+		float extent = r.r * sqrtf(MAX(0.0f, 1.0f - r.normal[k] * r.normal[k])) + r.R;
+		min[k] = r.center[k] - extent;
+		max[k] = r.center[k] + extent;
+	}
+}
+
+// the occluder blends back to the incoming potential at 1.5 times its radii
+inline void occluder_support(const SceneOccluder& o, float min[], float max[])
+{
+	for (int k = 0; k < 3; k++)
+	{
+		min[k] = o.center[k] - 1.5f * o.radius[k];
+		max[k] = o.center[k] + 1.5f * o.radius[k];
+	}
+}
+
+// cells are cubes sized for about one primitive each, at most max_res per axis
+inline void build_scene_index(CompiledScene* scene, int max_res = 64)
+{
+	struct Support
+	{
+		uint32 entry;
+		float min[3];
+		float max[3];
+	};
+	std::vector<Support> supports;
+	for (size_t i = 0; i < scene->vortices.size(); i++)
+	{
+		Support s;
+		s.entry = SCENE_VORTEX | static_cast<uint32>(i);
+		vortex_support(scene->vortices[i], s.min, s.max);
+		supports.push_back(s);
+	}
+	for (size_t i = 0; i < scene->rings.size(); i++)
+	{
+		Support s;
+		s.entry = SCENE_RING | static_cast<uint32>(i);
+		ring_support(scene->rings[i], s.min, s.max);
+		supports.push_back(s);
+	}
+	for (size_t i = 0; i < scene->occluders.size(); i++)
+	{
+		Support s;
+		s.entry = SCENE_OCCLUDER | static_cast<uint32>(i);
+		occluder_support(scene->occluders[i], s.min, s.max);
+		supports.push_back(s);
+	}
+
+	SceneIndex& index = scene->index;
+	index.entries.clear();
+	if (supports.empty())
+	{
+		index.res[0] = index.res[1] = index.res[2] = 0;
+		index.cell_start.assign(1, 0);
+		return;
+	}
+	float min[3] = { supports[0].min[0], supports[0].min[1], supports[0].min[2] };
+	float max[3] = { supports[0].max[0], supports[0].max[1], supports[0].max[2] };
+	for (const Support& s : supports)
+	{
+		for (int k = 0; k < 3; k++)
+		{
+			min[k] = MIN(min[k], s.min[k]);
+			max[k] = MAX(max[k], s.max[k]);
+		}
+	}
+	float extent[3];
+	for (int k = 0; k < 3; k++) extent[k] = MAX(max[k] - min[k], 1e-3f);
+	float cell = cbrtf(extent[0] * extent[1] * extent[2] / supports.size());
+	for (int k = 0; k < 3; k++) cell = MAX(cell, extent[k] / max_res);
+	for (int k = 0; k < 3; k++)
+	{
+		index.min[k] = min[k];
+		index.res[k] = CLAMP(static_cast<int>(ceilf(extent[k] / cell)), 1, max_res);
+	}
+	index.inv_cell = 1.0f / cell;
+
+	// counting sort, the supports are already in entry order so every cell ends up sorted
+	size_t cell_count = static_cast<size_t>(index.res[0]) * index.res[1] * index.res[2];
+	index.cell_start.assign(cell_count + 1, 0);
+	for (int pass = 0; pass < 2; pass++)
+	{
+		std::vector<uint32> fill;
+		if (pass == 1)
+		{
+			for (size_t c = 0; c < cell_count; c++) index.cell_start[c + 1] += index.cell_start[c];
+			index.entries.resize(index.cell_start[cell_count]);
+			fill.assign(index.cell_start.begin(), index.cell_start.end() - 1);
+		}
+		for (const Support& s : supports)
+		{
+			int lo[3], hi[3];
+			for (int k = 0; k < 3; k++)
+			{
+				lo[k] = CLAMP(static_cast<int>(floorf((s.min[k] - index.min[k]) * index.inv_cell)), 0, index.res[k] - 1);
+				hi[k] = CLAMP(static_cast<int>(floorf((s.max[k] - index.min[k]) * index.inv_cell)), 0, index.res[k] - 1);
+			}
+			for (int z = lo[2]; z <= hi[2]; z++)
+			{
+				for (int y = lo[1]; y <= hi[1]; y++)
+				{
+					for (int x = lo[0]; x <= hi[0]; x++)
+					{
+						size_t c = (static_cast<size_t>(z) * index.res[1] + y) * index.res[0] + x;
+						if (pass == 0) index.cell_start[c + 1]++;
+						else index.entries[fill[c]++] = s.entry;
+					}
+				}
+			}
+		}
+	}
+}
+
+// the primitives that can influence x, an empty range outside of every support
+inline void scene_cell(const SceneIndex& index, const float x[], const uint32** begin, const uint32** end)
+{
+	int cell[3];
+	for (int k = 0; k < 3; k++)
+	{
+		float f = (x[k] - index.min[k]) * index.inv_cell;
+		// written so NaN positions fail as well
+		if (!(f >= 0.0f && f < static_cast<float>(index.res[k])))
+		{
+			*begin = *end = nullptr;
+			return;
+		}
+		cell[k] = MIN(static_cast<int>(f), index.res[k] - 1);
+	}
+	size_t c = (static_cast<size_t>(cell[2]) * index.res[1] + cell[1]) * index.res[0] + cell[0];
+	*begin = index.entries.data() + index.cell_start[c];
+	*end = index.entries.data() + index.cell_start[c + 1];
+}
+
+// the helicopter potential_field hard-codes: downwash, main rotor wake and fuselage
+inline FieldScene default_scene()
+{
+	FieldScene scene;
+	scene.vortices.push_back(SceneVortex{ 5.95f, { 0.0f, 0.0f, 0.0f }, { 0.0f, -0.5f, 0.0f } });
+	scene.rotors.push_back(SceneRotor{ 5.95f, { 0.0f, 0.0f, 0.0f }, { 0.0f, 1.0f, 0.0f } });
+	scene.occluders.push_back(SceneOccluder{ { 0.0f, -1.6f, 0.0f }, { 1.0f, 1.6f, 4.5f } });
+	return scene;
+}
+
+// one primitive per line, # starts a comment:
+//   vortex   R  cx cy cz  wx wy wz
+//   ring     R r  cx cy cz  nx ny nz
+//   rotor    r  cx cy cz  nx ny nz
+//   occluder cx cy cz  rx ry rz
+inline bool load_scene(const std::string& path, FieldScene* scene)
+{
+	std::ifstream input(path);
+	if (!input.is_open())
+	{
+		std::cout << "Error reading scene file " << path << std::endl;
+		return false;
+	}
+	FieldScene loaded;
+	std::string line;
+	int line_number = 0;
+	while (std::getline(input, line))
+	{
+		line_number++;
+		size_t comment = line.find('#');
+		if (comment != std::string::npos) line.erase(comment);
+		std::istringstream stream(line);
+		std::string type;
+		if (!(stream >> type)) continue;
+		bool valid = false;
+		if (type == "vortex")
+		{
+			SceneVortex v;
+			valid = static_cast<bool>(stream >> v.R >> v.center[0] >> v.center[1] >> v.center[2] >> v.omega[0] >> v.omega[1] >> v.omega[2]) && v.R > 0.0f;
+			if (valid) loaded.vortices.push_back(v);
+		}
+		else if (type == "ring")
+		{
+			SceneRing r;
+			valid = static_cast<bool>(stream >> r.R >> r.r >> r.center[0] >> r.center[1] >> r.center[2] >> r.normal[0] >> r.normal[1] >> r.normal[2])
+				&& r.R > 0.0f && r.r > 0.0f && dot(r.normal, r.normal) > 0.0f;
+			if (valid) loaded.rings.push_back(r);
+		}
+		else if (type == "rotor")
+		{
+			SceneRotor r;
+			valid = static_cast<bool>(stream >> r.r >> r.center[0] >> r.center[1] >> r.center[2] >> r.normal[0] >> r.normal[1] >> r.normal[2])
+				&& r.r > 0.0f && dot(r.normal, r.normal) > 0.0f;
+			if (valid) loaded.rotors.push_back(r);
+		}
+		else if (type == "occluder")
+		{
+			SceneOccluder o;
+			valid = static_cast<bool>(stream >> o.center[0] >> o.center[1] >> o.center[2] >> o.radius[0] >> o.radius[1] >> o.radius[2])
+				&& o.radius[0] > 0.0f && o.radius[1] > 0.0f && o.radius[2] > 0.0f;
+			if (valid) loaded.occluders.push_back(o);
+		}
+		if (!valid)
+		{
+			std::cout << "Error in scene file " << path << " line " << line_number << ": " << line << std::endl;
+			return false;
+		}
+	}
+	*scene = loaded;
+	return true;
+}
+
+inline void compile_scene(const FieldScene& scene, float radius, CompiledScene* compiled)
+{
+	compiled->radius = radius;
+	compiled->vortices = scene.vortices;
+	compiled->rings.clear();
+	for (const SceneRing& ring : scene.rings)
+	{
+		SceneRing packed = ring;
+		normalise(packed.normal);
+		compiled->rings.push_back(packed);
+	}
+	for (const SceneRotor& rotor : scene.rotors)
+	{
+		float radius_function = -fabsf(radius - rotor.r) + rotor.r;
+		SceneRing ring;
+		for (int k = 0; k < 3; k++) ring.center[k] = rotor.center[k];
+		for (int k = 0; k < 3; k++) ring.normal[k] = rotor.normal[k];
+		normalise(ring.normal);
+		// rings without a core add nothing
+		if (radius_function > 0.0f)
+		{
+			ring.R = radius_function;
+			ring.r = rotor.r;
+			compiled->rings.push_back(ring);
+		}
+		// second vortex ring, starts after first vortex ring covers the whole rotor
+		if (radius > rotor.r && rotor.r - radius_function > 0.0f)
+		{
+			ring.R = rotor.r - radius_function;
+			ring.r = rotor.r - radius_function;
+			for (int k = 0; k < 3; k++) ring.normal[k] = -ring.normal[k];
+			compiled->rings.push_back(ring);
+		}
+	}
+	compiled->occluders = scene.occluders;
+	build_scene_index(compiled);
+}
+
+// the scene evaluators are templated on the scalar type like curl_noise_lanes.h, float for the simulation and double
+// for the reference path, the cell lookup is per point so there is no register wide version
+template <typename T>
+inline void scene_cell(const SceneIndex& index, const T x[], const uint32** begin, const uint32** end)
+{
+	const float position[3] = { static_cast<float>(x[0]), static_cast<float>(x[1]), static_cast<float>(x[2]) };
+	scene_cell(index, position, begin, end);
+}
+
+template <typename T>
+inline void scene_vortex_lanes(const SceneVortex& v, T center[], T omega[])
+{
+	for (int k = 0; k < 3; k++) center[k] = T(v.center[k]);
+	for (int k = 0; k < 3; k++) omega[k] = T(v.omega[k]);
+}
+
+// sum of the vortices and rings, then every occluder in turn, only the primitives whose support contains x
+template <typename T>
+inline void potential_field_lanes(const T x[], T potential[], const CompiledScene& scene)
+{
+	T phi[3] = { T(0.0f), T(0.0f), T(0.0f) };
+	T vec[3];
+	const uint32* entry;
+	const uint32* end;
+	scene_cell(scene.index, x, &entry, &end);
+	for (; entry != end; entry++)
+	{
+		uint32 i = *entry & ~SCENE_TYPE_MASK;
+		switch (*entry & SCENE_TYPE_MASK)
+		{
+		case SCENE_VORTEX:
+		{
+			T center[3], omega[3];
+			scene_vortex_lanes(scene.vortices[i], center, omega);
+			potential_vortex_lanes(scene.vortices[i].R, center, omega, x, vec);
+			for (int k = 0; k < 3; k++) phi[k] += vec[k];
+			break;
+		}
+		case SCENE_RING:
+		{
+			const SceneRing& r = scene.rings[i];
+			potential_vortex_ring_lanes(r.R, r.r, r.center, r.normal, x, vec);
+			for (int k = 0; k < 3; k++) phi[k] += vec[k];
+			break;
+		}
+		default:
+		{
+			const SceneOccluder& o = scene.occluders[i];
+			potential_occluder_lanes(o.center, o.radius, phi, x, vec);
+			for (int k = 0; k < 3; k++) phi[k] = vec[k];
+			break;
+		}
+		}
+	}
+	for (int k = 0; k < 3; k++) potential[k] = phi[k];
+}
+
+template <typename T>
+inline void potential_field_jacobian_lanes(const T x[], T potential[], T jac[3][3], const CompiledScene& scene)
+{
+	T phi[3] = { T(0.0f), T(0.0f), T(0.0f) };
+	T jphi[3][3] = { { T(0.0f), T(0.0f), T(0.0f) }, { T(0.0f), T(0.0f), T(0.0f) }, { T(0.0f), T(0.0f), T(0.0f) } };
+	T vec[3];
+	T jvec[3][3];
+	const uint32* entry;
+	const uint32* end;
+	scene_cell(scene.index, x, &entry, &end);
+	for (; entry != end; entry++)
+	{
+		uint32 e = *entry & ~SCENE_TYPE_MASK;
+		uint32 type = *entry & SCENE_TYPE_MASK;
+		if (type == SCENE_OCCLUDER)
+		{
+			const SceneOccluder& o = scene.occluders[e];
+			potential_occluder_jacobian_lanes(o.center, o.radius, phi, jphi, x, vec, jvec);
+			for (int i = 0; i < 3; i++)
+			{
+				phi[i] = vec[i];
+				for (int j = 0; j < 3; j++) jphi[i][j] = jvec[i][j];
+			}
+			continue;
+		}
+		if (type == SCENE_VORTEX)
+		{
+			T center[3], omega[3];
+			scene_vortex_lanes(scene.vortices[e], center, omega);
+			potential_vortex_jacobian_lanes(scene.vortices[e].R, center, omega, x, vec, jvec);
+		}
+		else
+		{
+			const SceneRing& r = scene.rings[e];
+			potential_vortex_ring_jacobian_lanes(r.R, r.r, r.center, r.normal, x, vec, jvec);
+		}
+		for (int i = 0; i < 3; i++)
+		{
+			phi[i] += vec[i];
+			for (int j = 0; j < 3; j++) jphi[i][j] += jvec[i][j];
+		}
+	}
+	for (int i = 0; i < 3; i++)
+	{
+		potential[i] = phi[i];
+		for (int j = 0; j < 3; j++) jac[i][j] = jphi[i][j];
+	}
+}
+
+// potential evaluations behind one velocity_field_lanes call
+#ifdef CURL_NOISE_FINITE_DIFFERENCES
+#define SCENE_POTENTIALS_PER_FIELD 4
+#else
+#define SCENE_POTENTIALS_PER_FIELD 1
+#endif
+
+// curl of the scene potential, same sign convention as velocity_field
+template <typename T>
+inline void velocity_field_lanes(const T x[], T vec[], const CompiledScene& scene)
+{
+#ifdef CURL_NOISE_FINITE_DIFFERENCES
+	const T eps = T(1e-4f);
+	T p[3], px[3], py[3], pz[3];
+	T xx[3] = { x[0] + eps, x[1], x[2] };
+	T xy[3] = { x[0], x[1] + eps, x[2] };
+	T xz[3] = { x[0], x[1], x[2] + eps };
+	potential_field_lanes(x, p, scene);
+	potential_field_lanes(xx, px, scene);
+	potential_field_lanes(xy, py, scene);
+	potential_field_lanes(xz, pz, scene);
+	vec[0] = ((p[2] - py[2]) - (p[1] - pz[1])) / eps;
+	vec[1] = ((p[0] - pz[0]) - (p[2] - px[2])) / eps;
+	vec[2] = ((p[1] - px[1]) - (p[0] - py[0])) / eps;
+#else
+	T potential[3];
+	T jac[3][3];
+	potential_field_jacobian_lanes(x, potential, jac, scene);
+	vec[0] = jac[1][2] - jac[2][1];
+	vec[1] = jac[2][0] - jac[0][2];
+	vec[2] = jac[0][1] - jac[1][0];
+#endif
+}
+
+inline void potential_field(const float x[], float potential[], const CompiledScene& scene)
+{
+	potential_field_lanes(x, potential, scene);
+}
+
+inline void potential_field_jacobian(const float x[], float potential[], float jac[3][3], const CompiledScene& scene)
+{
+	potential_field_jacobian_lanes(x, potential, jac, scene);
+}
+
+inline void velocity_field(const float x[], float vec[], const CompiledScene& scene)
+{
+	velocity_field_lanes(x, vec, scene);
+}
+
+// the scene in double precision, the reference the float path is measured against
+inline void potential_field_reference(const double x[], double potential[], const CompiledScene& scene)
+{
+	potential_field_lanes(x, potential, scene);
+}
+
+inline void velocity_field_reference(const double x[], double vec[], const CompiledScene& scene)
+{
+	velocity_field_lanes(x, vec, scene);
+}
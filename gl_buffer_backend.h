@@ -0,0 +1,95 @@
+#pragma once
+#include <GL/glew.h>
+
+#include "defines.h"
+#include "buffer_backend.h"
+#include "vertex_buffer.h"
+
+// vertex array and buffer for one of the vertex layouts
+class GLBufferBackend : public BufferBackend
+{
+public:
+	explicit GLBufferBackend(VertexLayout layout = VertexLayout::Basic) : layout(layout)
+	{
+		glGenVertexArrays(1, &vao);
+		glGenBuffers(1, &bufferId);
+	}
+
+	virtual ~GLBufferBackend()
+	{
+		if (mapped)
+		{
+			glBindBuffer(GL_ARRAY_BUFFER, bufferId);
+			glUnmapBuffer(GL_ARRAY_BUFFER);
+		}
+		glDeleteBuffers(1, &bufferId);
+		glDeleteVertexArrays(1, &vao);
+	}
+
+	void* create_persistent(uint64 bytes, const void* data) override
+	{
+		// buffer storage is core since 4.4
+		if (!GLEW_ARB_buffer_storage) return nullptr;
+		setup();
+		const GLbitfield flags = GL_MAP_WRITE_BIT | GL_MAP_PERSISTENT_BIT | GL_MAP_COHERENT_BIT;
+		glBufferStorage(GL_ARRAY_BUFFER, bytes, data, flags);
+		mapped = glMapBufferRange(GL_ARRAY_BUFFER, 0, bytes, flags);
+		glBindVertexArray(0);
+		return mapped;
+	}
+
+	void create_dynamic(uint64 bytes, const void* data) override
+	{
+		setup();
+		glBufferData(GL_ARRAY_BUFFER, bytes, data, GL_DYNAMIC_DRAW);
+		glBindVertexArray(0);
+	}
+
+	void sub_data(uint64 offset, uint64 bytes, const void* data) override
+	{
+		glBindBuffer(GL_ARRAY_BUFFER, bufferId);
+		glBufferSubData(GL_ARRAY_BUFFER, offset, bytes, data);
+	}
+
+	void* fence() override
+	{
+		return glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+	}
+
+	void wait(void* fence) override
+	{
+		GLsync sync = static_cast<GLsync>(fence);
+		// flush on the first try so the fence is guaranteed to signal
+		GLbitfield flags = GL_SYNC_FLUSH_COMMANDS_BIT;
+		while (true)
+		{
+			GLenum result = glClientWaitSync(sync, flags, 1000000);
+			if (result == GL_ALREADY_SIGNALED || result == GL_CONDITION_SATISFIED || result == GL_WAIT_FAILED) return;
+			flags = 0;
+		}
+	}
+
+	void delete_fence(void* fence) override
+	{
+		glDeleteSync(static_cast<GLsync>(fence));
+	}
+
+	void bind() override
+	{
+		glBindVertexArray(vao);
+		glBindBuffer(GL_ARRAY_BUFFER, bufferId);
+	}
+
+private:
+	void setup()
+	{
+		glBindVertexArray(vao);
+		glBindBuffer(GL_ARRAY_BUFFER, bufferId);
+		set_vertex_layout(layout);
+	}
+
+	VertexLayout layout;
+	GLuint vao;
+	GLuint bufferId;
+	void* mapped = nullptr;
+};
@@ -0,0 +1,254 @@
+// curl noise advection without a window, SDL or OpenGL, for compute nodes and regression runs
+// only needs glm, build it from this file alone, with -D_RELEASE for throughput numbers, without it the run is
+// instrumented for -p and the summary says so
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#include <string>
+#include <vector>
+
+#include "defines.h"
+#include "perf_counters.h"
+#include "profiler.h"
+#include "streamline_export.h"
+#include "thread_pool.h"
+#include "tracer.h"
+#include "trajectory.h"
+
+static void print_usage()
+{
+	std::cout << "usage: headless [options]\n"
+		<< "  -n i j k      tracer grid dimensions (15 15 15)\n"
+		<< "  -l count      trail length in line segments per tracer (20)\n"
+		<< "  -s steps      simulation steps (100)\n"
+		<< "  -d size       integration step size (0.005)\n"
+		<< "  -i method     integrator, euler, rk2, rk4 or rk45 (euler)\n"
+		<< "  -e tolerance  rk45 local position error per substep (0.0001)\n"
+		<< "  -a lifetime   particles respawn at their seed after this much integration time, 0 never (0)\n"
+		<< "  -r radius     vortex ring radius, 0 to 11.9 (5.95)\n"
+		<< "  -t threads    worker threads, 0 uses every hardware thread (0)\n"
+		<< "  -f file       field scene, the built-in helicopter if not given\n"
+		<< "  -g            sample a baked trilinear velocity grid instead of the analytic field\n"
+		<< "  -o file       streamline output, .csv text, .vtk legacy VTK, .vtp VTK XML polydata, anything else binary (streamlines.bin)\n"
+		<< "  -w file       records the positions of every step to a trajectory file for replay\n"
+		<< "  -v file       decodes every frame of a trajectory file recorded with the same options and compares it to the run, the timing includes the decoding\n"
+		<< "  -p file       chrome trace of the run, needs a build without _RELEASE\n"
+		<< "  -m            hardware counters per tracer-step through perf_event_open, linux only\n";
+}
+
+int main(int argc, char** argv)
+{
+	int i_trace_count = 15;
+	int j_trace_count = 15;
+	int k_trace_count = 15;
+	int l_trace_count = 20;
+	int steps = 100;
+	float step_size = 0.005f;
+	float lifetime = 0.0f;
+	IntegratorSettings integrator;
+	float radius = 5.95f;
+	unsigned int thread_count = 0;
+	bool use_grid = false;
+	std::string scene_path;
+	std::string output_path = "streamlines.bin";
+	std::string trace_path;
+	std::string trajectory_path;
+	std::string verify_path;
+	bool hardware_counters = false;
+	const float tracing_height = 8.0f;
+	const float tracing_width = 15.0f;
+
+	for (int a = 1; a < argc; a++)
+	{
+		if (strcmp(argv[a], "-n") == 0 && a + 3 < argc)
+		{
+			i_trace_count = atoi(argv[++a]);
+			j_trace_count = atoi(argv[++a]);
+			k_trace_count = atoi(argv[++a]);
+		}
+		else if (strcmp(argv[a], "-l") == 0 && a + 1 < argc) l_trace_count = atoi(argv[++a]);
+		else if (strcmp(argv[a], "-s") == 0 && a + 1 < argc) steps = atoi(argv[++a]);
+		else if (strcmp(argv[a], "-d") == 0 && a + 1 < argc) step_size = static_cast<float>(atof(argv[++a]));
+		else if (strcmp(argv[a], "-i") == 0 && a + 1 < argc)
+		{
+			std::string method = argv[++a];
+			if (method == "euler") integrator.integrator = Integrator::Euler;
+			else if (method == "rk2") integrator.integrator = Integrator::RK2;
+			else if (method == "rk4") integrator.integrator = Integrator::RK4;
+			else if (method == "rk45") integrator.integrator = Integrator::RK45;
+			else
+			{
+				print_usage();
+				return 1;
+			}
+		}
+		else if (strcmp(argv[a], "-e") == 0 && a + 1 < argc) integrator.tolerance = static_cast<float>(atof(argv[++a]));
+		else if (strcmp(argv[a], "-a") == 0 && a + 1 < argc) lifetime = static_cast<float>(atof(argv[++a]));
+		else if (strcmp(argv[a], "-r") == 0 && a + 1 < argc) radius = static_cast<float>(atof(argv[++a]));
+		else if (strcmp(argv[a], "-t") == 0 && a + 1 < argc) thread_count = static_cast<unsigned int>(atoi(argv[++a]));
+		else if (strcmp(argv[a], "-f") == 0 && a + 1 < argc) scene_path = argv[++a];
+		else if (strcmp(argv[a], "-g") == 0) use_grid = true;
+		else if (strcmp(argv[a], "-o") == 0 && a + 1 < argc) output_path = argv[++a];
+		else if (strcmp(argv[a], "-w") == 0 && a + 1 < argc) trajectory_path = argv[++a];
+		else if (strcmp(argv[a], "-v") == 0 && a + 1 < argc) verify_path = argv[++a];
+		else if (strcmp(argv[a], "-p") == 0 && a + 1 < argc) trace_path = argv[++a];
+		else if (strcmp(argv[a], "-m") == 0) hardware_counters = true;
+		else
+		{
+			print_usage();
+			return 1;
+		}
+	}
+	if (i_trace_count <= 0 || j_trace_count <= 0 || k_trace_count <= 0 || l_trace_count <= 0 || steps < 0 || lifetime < 0.0f || !(integrator.tolerance > 0.0f))
+	{
+		print_usage();
+		return 1;
+	}
+
+	FieldScene field_scene = default_scene();
+	if (!scene_path.empty() && !load_scene(scene_path, &field_scene)) return 1;
+	CompiledScene scene;
+	compile_scene(field_scene, radius, &scene);
+
+	ParticleStore particles;
+	Trails trails;
+	init_tracers(&particles, &trails, i_trace_count, j_trace_count, k_trace_count, l_trace_count, tracing_width, tracing_height);
+	if (lifetime > 0.0f) enable_lifetime(&particles, lifetime);
+	if (integrator.integrator == Integrator::RK45) enable_adaptive_step(&particles, step_size);
+	const size_t tracer_count = trails.tracer_count;
+
+	// the writer thread starts before the counters so its encoding is not counted as tracer work
+	TrajectoryWriter trajectory_writer;
+	if (!trajectory_path.empty())
+	{
+		float min[3], max[3];
+		trajectory_bounds(tracing_width, tracing_height, tracing_width, min, max);
+		if (!trajectory_writer.open(trajectory_path.c_str(), tracer_count, min, max, step_size)) return 1;
+		trajectory_writer.push(particles);
+	}
+
+	// frame 0 holds the seeds, frame s + 1 the positions after step s
+	TrajectoryReader trajectory_reader;
+	const uint64 frame_count = static_cast<uint64>(steps) + 1;
+	const uint64 middle_frame = frame_count / 2;
+	float verify_error = 0.0f;
+	ParticleStore first_particles;
+	ParticleStore middle_particles;
+	if (!verify_path.empty())
+	{
+		if (!trajectory_reader.open(verify_path.c_str())) return 1;
+		if (trajectory_reader.getTracer_count() != tracer_count || trajectory_reader.getFrame_count() != frame_count)
+		{
+			std::cout << verify_path << " holds " << trajectory_reader.getFrame_count() << " frames of " << trajectory_reader.getTracer_count()
+				<< " tracers, the run " << frame_count << " of " << tracer_count << std::endl;
+			return 1;
+		}
+		if (!trajectory_reader.seek(0)) return 1;
+		verify_error = trajectory_reader.getError(particles);
+		first_particles = particles;
+		if (middle_frame == 0) middle_particles = particles;
+	}
+
+	// before the thread pool, the counters only follow threads started after them
+	PerfCounters perf_counters;
+	bool counting = hardware_counters && perf_counters.open();
+	ThreadPool thread_pool(thread_count);
+	VelocityGrid grid;
+	if (use_grid)
+	{
+		auto bake_start = std::chrono::steady_clock::now();
+		grid.init(glm::vec3(-12.0f, -12.0f, -12.0f), glm::vec3(12.0f, 6.0f, 12.0f), 97, 73, 97);
+		grid.build(scene, thread_pool);
+		double bake_seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - bake_start).count();
+		std::cout << "baked velocity grid in " << bake_seconds << " s" << std::endl;
+	}
+
+	std::atomic<uint64> evaluations{ 0 };
+	if (counting) perf_counters.start();
+	auto start = std::chrono::steady_clock::now();
+	PROFILE_THREAD_NAME("main");
+	for (int s = 0; s < steps; s++)
+	{
+		PROFILE_SCOPE("step");
+		thread_pool.parallel_for(tracer_count, 16, [&](size_t begin, size_t end)
+		{
+			evaluations += calculate_new_positions(begin, end, &particles, scene, step_size, use_grid ? &grid : nullptr, GridInterpolation::Trilinear, integrator);
+			record_trails(begin, end, particles, &trails);
+		}, "advect");
+		// quantizes here, encodes and writes on the writer thread
+		if (!trajectory_path.empty()) trajectory_writer.push(particles);
+		// one delta per step
+		if (!verify_path.empty())
+		{
+			if (!trajectory_reader.seek(s + 1)) return 1;
+			verify_error = std::max(verify_error, trajectory_reader.getError(particles));
+			if (static_cast<uint64>(s) + 1 == middle_frame) middle_particles = particles;
+		}
+#ifndef _RELEASE
+		profiler().sample_counters();
+#endif
+	}
+	double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+	CounterValues counters;
+	if (counting) counters = perf_counters.stop();
+
+	double tracer_steps = static_cast<double>(tracer_count) * steps;
+	std::cout << "tracers: " << tracer_count << ", steps: " << steps << ", threads: " << thread_pool.getThread_count()
+		<< ", integrator: " << integrator_name(integrator.integrator) << ", profiling: " << (PROFILING ? "on" : "off") << std::endl;
+	std::cout << "time: " << seconds << " s" << std::endl;
+	if (seconds > 0.0)
+	{
+		std::cout << "throughput: " << tracer_steps / seconds << " tracer-steps/s, "
+			<< evaluations / seconds << " field evaluations/s" << std::endl;
+	}
+	if (tracer_steps > 0.0)
+	{
+		std::cout << "field evaluations per tracer-step: " << evaluations / tracer_steps << std::endl;
+		for (int c = 0; c < HARDWARE_COUNTER_COUNT; c++)
+		{
+			if (counters.available[c]) std::cout << hardware_counter_name(static_cast<HardwareCounter>(c)) << " per tracer-step: " << counters.values[c] / tracer_steps << std::endl;
+		}
+		const int cycles = static_cast<int>(HardwareCounter::Cycles);
+		const int instructions = static_cast<int>(HardwareCounter::Instructions);
+		if (counters.available[cycles] && counters.available[instructions] && counters.values[cycles] > 0.0)
+		{
+			std::cout << "instructions per cycle: " << counters.values[instructions] / counters.values[cycles] << std::endl;
+		}
+	}
+
+	if (!verify_path.empty())
+	{
+		// back to a keyframe and the deltas after it, then to the first keyframe
+		if (!trajectory_reader.seek(middle_frame)) return 1;
+		verify_error = std::max(verify_error, trajectory_reader.getError(middle_particles));
+		if (!trajectory_reader.seek(0)) return 1;
+		verify_error = std::max(verify_error, trajectory_reader.getError(first_particles));
+		std::cout << "trajectory: " << frame_count << " frames, largest error " << verify_error << " quantization steps" << std::endl;
+		// half a step plus the rounding of the dequantized float
+		if (!(verify_error <= 0.51f))
+		{
+			std::cout << verify_path << " does not match the run" << std::endl;
+			return 1;
+		}
+	}
+
+	{
+		// the simulation is done with the pool
+		StreamlineExporter exporter(&thread_pool);
+		if (!exporter.start(output_path, streamline_format(output_path), streamline_source(trails)) || !exporter.wait()) return 1;
+	}
+	if (!trajectory_writer.close()) return 1;
+	if (!trace_path.empty())
+	{
+#ifdef _RELEASE
+		std::cout << "profiling is compiled out of release builds, no trace written" << std::endl;
+#else
+		if (!profiler().write_chrome_trace(trace_path.c_str())) return 1;
+#endif
+	}
+	return 0;
+}
@@ -5,7 +5,7 @@
 
 struct IndexBuffer
 {
-	IndexBuffer(void* data, uint32 numIndices, uint8 elementSize)
+	IndexBuffer(const void* data, uint32 numIndices, uint8 elementSize)
 	{
 		glGenBuffers(1, &bufferId);
 		glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, bufferId);
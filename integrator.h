@@ -0,0 +1,120 @@
+#pragma once
+#include <algorithm>
+#include <cmath>
+
+#include "glm.hpp"
+#include "defines.h"
+
+// explicit integrators for dx/dt = v(x) with a steady field, field(p) returns the velocity at p
+enum class Integrator { Euler, RK2, RK4, RK45 };
+
+inline const char* integrator_name(Integrator integrator)
+{
+	switch (integrator)
+	{
+	case Integrator::RK2: return "RK2";
+	case Integrator::RK4: return "RK4";
+	case Integrator::RK45: return "RK45";
+	default: return "Euler";
+	}
+}
+
+struct IntegratorSettings
+{
+	Integrator integrator = Integrator::Euler;
+	float tolerance = 1e-4f;  // RK45, largest local position error per substep in world units
+	float min_step = 1e-5f;   // RK45 accepts the substep anyway once it is this small
+	int max_substeps = 64;    // RK45 per interval, the rest of the interval is taken in one go
+};
+
+inline int evaluations_per_step(Integrator integrator)
+{
+	switch (integrator)
+	{
+	case Integrator::RK2: return 2;
+	case Integrator::RK4: return 4;
+	case Integrator::RK45: return 6;
+	default: return 1;
+	}
+}
+
+template <typename Field>
+inline glm::vec3 integrate_euler(const glm::vec3& p, float h, Field& field)
+{
+	return p + h * field(p);
+}
+
+// midpoint method
+template <typename Field>
+inline glm::vec3 integrate_rk2(const glm::vec3& p, float h, Field& field)
+{
+	glm::vec3 k1 = field(p);
+	glm::vec3 k2 = field(p + (0.5f * h) * k1);
+	return p + h * k2;
+}
+
+template <typename Field>
+inline glm::vec3 integrate_rk4(const glm::vec3& p, float h, Field& field)
+{
+	glm::vec3 k1 = field(p);
+	glm::vec3 k2 = field(p + (0.5f * h) * k1);
+	glm::vec3 k3 = field(p + (0.5f * h) * k2);
+	glm::vec3 k4 = field(p + h * k3);
+	return p + (h / 6.0f) * (k1 + 2.0f * k2 + 2.0f * k3 + k4);
+}
+
+// Dormand-Prince 5(4) over the whole interval, *h is the substep size carried between calls
+// the last stage is the first stage of the next substep, so an accepted substep costs 6 evaluations
+// returns the number of field evaluations
+template <typename Field>
+inline int integrate_rk45(glm::vec3* p, float interval, float* h, const IntegratorSettings& settings, Field& field)
+{
+	const float a21 = 1.0f / 5.0f;
+	const float a31 = 3.0f / 40.0f, a32 = 9.0f / 40.0f;
+	const float a41 = 44.0f / 45.0f, a42 = -56.0f / 15.0f, a43 = 32.0f / 9.0f;
+	const float a51 = 19372.0f / 6561.0f, a52 = -25360.0f / 2187.0f, a53 = 64448.0f / 6561.0f, a54 = -212.0f / 729.0f;
+	const float a61 = 9017.0f / 3168.0f, a62 = -355.0f / 33.0f, a63 = 46732.0f / 5247.0f, a64 = 49.0f / 176.0f, a65 = -5103.0f / 18656.0f;
+	const float b1 = 35.0f / 384.0f, b3 = 500.0f / 1113.0f, b4 = 125.0f / 192.0f, b5 = -2187.0f / 6784.0f, b6 = 11.0f / 84.0f;
+	// difference between the 5th and the embedded 4th order weights
+	const float e1 = 71.0f / 57600.0f, e3 = -71.0f / 16695.0f, e4 = 71.0f / 1920.0f, e5 = -17253.0f / 339200.0f, e6 = 22.0f / 525.0f, e7 = -1.0f / 40.0f;
+
+	float step = (*h > 0.0f && std::isfinite(*h)) ? std::min(*h, interval) : interval;
+	float t = 0.0f;
+	int evaluations = 1;
+	int substeps = 0;
+	glm::vec3 y = *p;
+	glm::vec3 k1 = field(y);
+	while (interval - t > 1e-7f * interval)
+	{
+		if (++substeps > settings.max_substeps) step = interval - t;
+		float s = std::min(step, interval - t);
+		glm::vec3 k2 = field(y + s * (a21 * k1));
+		glm::vec3 k3 = field(y + s * (a31 * k1 + a32 * k2));
+		glm::vec3 k4 = field(y + s * (a41 * k1 + a42 * k2 + a43 * k3));
+		glm::vec3 k5 = field(y + s * (a51 * k1 + a52 * k2 + a53 * k3 + a54 * k4));
+		glm::vec3 k6 = field(y + s * (a61 * k1 + a62 * k2 + a63 * k3 + a64 * k4 + a65 * k5));
+		glm::vec3 next = y + s * (b1 * k1 + b3 * k3 + b4 * k4 + b5 * k5 + b6 * k6);
+		glm::vec3 k7 = field(next);
+		evaluations += 6;
+
+		glm::vec3 e = s * (e1 * k1 + e3 * k3 + e4 * k4 + e5 * k5 + e6 * k6 + e7 * k7);
+		float error = std::max(std::fabs(e.x), std::max(std::fabs(e.y), std::fabs(e.z)));
+		// NaN from a singular point in the field is accepted as is, shrinking would not help
+		float scale = error > 0.0f ? 0.9f * std::pow(settings.tolerance / error, 0.2f) : 5.0f;
+		if (!std::isfinite(error)) scale = 1.0f;
+		bool accept = !(error > settings.tolerance) || s <= settings.min_step || substeps > settings.max_substeps;
+		if (accept)
+		{
+			t += s;
+			y = next;
+			k1 = k7;
+		}
+		float proposed = s * std::min(5.0f, std::max(0.2f, scale));
+		// a substep cut short by the end of the interval says nothing about the size the next one can have
+		if (accept && s < step) proposed = std::max(proposed, step);
+		step = std::max(settings.min_step, proposed);
+	}
+	*p = y;
+	*h = step;
+	return evaluations;
+}
@@ -19,51 +19,24 @@
 #pragma comment(lib, "glew32.lib")
 #pragma comment(lib, "opengl32.lib")
 
-#define FEET_TO_METER 3.28084
-
 #include "curl_noise.h"
 #include "defines.h"
 #include "vertex_buffer.h"
+#include "gl_buffer_backend.h"
+#include "streaming_vertex_buffer.h"
 #include "shader.h"
 #include "fps_camera.h"
 #include "floating_camera.h"
 #include "index_buffer.h"
 #include "mesh.h"
+#include "field_scene.h"
+#include "velocity_grid.h"
+#include "tracer.h"
+#include "simulation.h"
+#include "streamline_export.h"
+#include "profiler.h"
 
 
-int readModel(std::vector<Vertex>* vertices, uint64* num_vertices, std::vector<uint32>* indices, uint64* num_indices, const std::string path)
-{
-	std::ifstream input = std::ifstream(path, std::ios::in | std::ios::binary);
-	if (!input.is_open())
-	{
-		std::cout << "Error reading model file." << std::endl;
-		return 1;
-	}
-	input.read(reinterpret_cast<char*>(num_vertices), sizeof(uint64));
-	input.read(reinterpret_cast<char*>(num_indices), sizeof(uint64));
-
-	for (uint64 i = 0; i < *num_vertices; i++)
-	{
-		Vertex vertex;
-		input.read(reinterpret_cast<char*>(&vertex.position.x), sizeof(float));
-		input.read(reinterpret_cast<char*>(&vertex.position.y), sizeof(float));
-		input.read(reinterpret_cast<char*>(&vertex.position.z), sizeof(float));
-		vertex.color.r = 1.0f;
-		vertex.color.g = 1.0f;
-		vertex.color.b = 1.0f;
-		vertex.color.a = 1.0f;
-		(*vertices).push_back(vertex);
-	}
-
-	for (uint64 i = 0; i < *num_indices; i++)
-	{
-		uint32 index;
-		input.read(reinterpret_cast<char*>(&index), sizeof(uint32));
-		(*indices).push_back(index);
-	}
-	return 0;
-}
-
 void openGLDebugCallback(GLenum source, GLenum type, GLuint id, GLenum severity, GLsizei length, const GLchar* message, const void* user_param)
 {
 	//std::cout << "[OpenGL Error] " << message << std::endl;
@@ -75,84 +48,6 @@ void _GLGetError(const char* file, int line, const char* call)
 		std::cout << "[OpenGL Error] " << glewGetErrorString(error) << " in " << file << ":" << line << " Call: " << call << std::endl;
 }
 
-void calculate_new_positions(int i, int j_trace_count, int k_trace_count, int l_trace_count, std::vector<Vertex>* vertices, float radius)
-{
-	for (int j = 0; j < j_trace_count; j++)
-	{
-		for (int k = 0; k < k_trace_count; k++)
-		{
-			// move lines as a whole
-#if 1
-			int index = l_trace_count * 2.0f * k + (l_trace_count * k_trace_count * 2.0f) * j + (l_trace_count * k_trace_count * j_trace_count * 2.0f) * i;
-			Vertex v = (*vertices)[index + l_trace_count * 2.0f - 1.0f];
-			v.color.r = 0.0f;
-			v.color.g = 0.0f;
-			v.color.b = 1.0f;
-			(*vertices)[index] = v;
-			glm::vec3 p = v.position;
-			glm::vec3 flow;
-#if 0
-			for (int l = 1; l < l_trace_count; l++)
-			{
-				flow = velocity_field(p);
-				p += 0.005f * flow;
-				vertices[index + l * 2.0f - 1.0f]
-					= Vertex{ p, glm::vec4(static_cast<float>(l) / static_cast<float>(l_trace_count), 0.0f, (1.0f - static_cast<float>(l) / static_cast<float>(l_trace_count)), 1.0f) };
-				vertices[index + l * 2.0f]
-					= Vertex{ p, glm::vec4(static_cast<float>(l) / static_cast<float>(l_trace_count), 0.0f, (1.0f - static_cast<float>(l) / static_cast<float>(l_trace_count)), 1.0f) };
-			}
-			flow = velocity_field(p);
-			p += 0.005f * flow;
-			vertices[index + l_trace_count * 2.0f - 1.0f]
-				= Vertex{ p, glm::vec4(1.0f, 0.0f, 0.0f, 1.0f) };
-			// move lines step by step
-#else
-			float pos[3] = { p.x, p.y, p.z };
-			float flowarr[3] = { 0.0f, 0.0f, 0.0f };
-			float center[3] = { 0.0f, 0.0f, 0.0f };
-			for (int l = 1; l < l_trace_count; l++)
-			{
-				velocity_field(pos, flowarr, center, radius);
-				for (int k = 0; k < 3; k++) pos[k] += 0.005f * flowarr[k];
-				p += 0.005f * flow;
-				(*vertices)[index + l * 2.0f - 1.0f]
-					= Vertex{ glm::vec3(pos[0], pos[1], pos[2]), glm::vec4(static_cast<float>(l) / static_cast<float>(l_trace_count), 0.0f, (1.0f - static_cast<float>(l) / static_cast<float>(l_trace_count)), 1.0f) };
-				(*vertices)[index + l * 2.0f]
-					= Vertex{ glm::vec3(pos[0], pos[1], pos[2]), glm::vec4(static_cast<float>(l) / static_cast<float>(l_trace_count), 0.0f, (1.0f - static_cast<float>(l) / static_cast<float>(l_trace_count)), 1.0f) };
-			}
-			velocity_field(pos, flowarr, center, radius);
-			for (int k = 0; k < 3; k++) pos[k] += 0.005f * flowarr[k];
-			p += 0.005f * flow;
-			(*vertices)[index + l_trace_count * 2.0f - 1.0f]
-				= Vertex{ glm::vec3(pos[0], pos[1], pos[2]), glm::vec4(1.0f, 0.0f, 0.0f, 1.0f) };
-#endif
-#else
-			int index = l_trace_count * 2.0f * k + (l_trace_count * k_trace_count * 2.0f) * j + (l_trace_count * k_trace_count * j_trace_count * 2.0f) * i;
-			vertices[index] = vertices[index + 1.0f];
-			vertices[index].color.r = 0.0f;
-			vertices[index].color.b = 1.0f;
-			for (int l = 1; l < l_trace_count - 1; l++)
-			{
-				vertices[index + l * 2.0f - 1.0f] = vertices[index + l * 2.0f + 1.0f];
-				vertices[index + l * 2.0f - 1.0f].color.r = static_cast<float>(l) / static_cast<float>(l_trace_count);
-				vertices[index + l * 2.0f - 1.0f].color.b = (1.0f - static_cast<float>(l) / static_cast<float>(l_trace_count));
-				vertices[index + l * 2.0f] = vertices[index + l * 2.0f + 2.0f];
-				vertices[index + l * 2.0f].color.r = static_cast<float>(l) / static_cast<float>(l_trace_count);
-				vertices[index + l * 2.0f].color.b = (1.0f - static_cast<float>(l) / static_cast<float>(l_trace_count));
-			}
-			vertices[index + l_trace_count * 2.0f - 3.0f] = vertices[index + l_trace_count * 2.0f - 2.0f] = vertices[index + l_trace_count * 2.0f - 1.0f];
-			Vertex v = vertices[index + l_trace_count * 2.0f - 1.0f];
-			glm::vec3 p = v.position;
-			glm::vec3 flow;
-			flow = velocity_field(p);
-			p += 0.005f * flow;
-			vertices[index + l_trace_count * 2.0f - 1.0f]
-				= Vertex{ p, glm::vec4(1.0f, 0.0f, 0.0f, 1.0f) };
-#endif
-		}
-	}
-}
-
 int main(int argc, char** argv) {
 	// SDL
 	SDL_Window* window;
@@ -193,22 +88,6 @@ int main(int argc, char** argv) {
 	std::vector<Vertex> vertices;
 	uint64 num_vertices = 0;
 
-	std::vector<uint32> indices;
-	uint64 num_indices = 0;
-
-	readModel(&vertices, &num_vertices, &indices, &num_indices, "models/rotor_blades.bmf");
-	for (int i = 0; i < vertices.size(); i++)
-	{
-		vertices[i].position.x /= FEET_TO_METER;
-		vertices[i].position.y /= FEET_TO_METER;
-		vertices[i].position.z /= FEET_TO_METER;
-	}
-	
-	IndexBuffer index_buffer_rotor_blades(indices.data(), num_indices, sizeof(indices[0]));
-	VertexBuffer vertex_buffer_rotor_blades(vertices.data(), num_vertices);
-	vertices.clear();
-	indices.clear();
-	
 	vertices.push_back(Vertex{ glm::vec3(0.0f, 0.0f, 0.0f), glm::vec4(1.0f, 0.0f, 0.0f, 1.0f) });
 	vertices.push_back(Vertex{ glm::vec3(5.95f, 0.0f, 0.0f), glm::vec4(1.0f, 0.0f, 0.0f, 1.0f) });
 	// debug lines at every unit on the x axis
@@ -246,32 +125,33 @@ int main(int argc, char** argv) {
 	const int l_trace_count = 20;
 	const float tracing_height = 8.0f;
 	const float tracing_width = 15.0f;
-	
-	for (int i = 0; i < i_trace_count; i++)
+	// record writes the tracer positions of every step here, replay plays them back instead of simulating
+	const char* trajectory_path = "recording.trj";
+	// the current trails for external tools, encoded next to the simulation instead of on its workers
+	StreamlineExporter streamline_exporter(std::max(2u, std::thread::hardware_concurrency() / 2));
+	int export_format = static_cast<int>(StreamlineFormat::VtkXml);
+	// primitives of the field, compiled again whenever the vortex ring slider moves
+	FieldScene field_scene;
+	if (!load_scene("models/heli.scene", &field_scene))
 	{
-		for (int j = 0; j < j_trace_count; j++)
-		{
-			for (int k = 0; k < k_trace_count; k++)
-			{
-				for (int l = 0; l < l_trace_count; l++)
-				{
-					glm::vec3 position((tracing_width / 2.0f) - i * (tracing_width / i_trace_count) + 0.1f,
-						(tracing_height / 2.0f) - k * (tracing_height / k_trace_count) - 0.1f * l + 0.1f,
-						(tracing_width / 2.0f) - j * (tracing_width / i_trace_count) + 0.1f);
-					Vertex top = { position,glm::vec4(0.0f, 0.0f, 1.0f, 1.0f) };
-					position.y = (tracing_height / 2.0f) - k * (tracing_height / k_trace_count) - 0.1f * (l + 1.0f) + 0.1f;
-					Vertex bottom = { position,glm::vec4(1.0f, 0.0f, 0.0f, 1.0f) };
-					vertices.push_back(top);
-					vertices.push_back(bottom);
-				}
-			}
-		}
+		field_scene = default_scene();
 	}
-	num_vertices = vertices.size();
-
-	VertexBuffer tracing_vertex_buffer(vertices.data(), num_vertices);
+	// advection runs on its own thread, the frames only pick up its latest snapshot
+	SimulationSettings simulation_settings;
+	Simulation simulation(field_scene, i_trace_count, j_trace_count, k_trace_count, l_trace_count, tracing_width, tracing_height);
+	simulation.update_snapshot();
+	// one line strip per tracer, 16 byte vertices and no duplicated points
+	std::vector<uint32> tracer_indices;
+	trail_strip_indices(simulation.getSnapshot().tracer_count, simulation.getSnapshot().trail_length, &tracer_indices);
+
+	GLBufferBackend tracing_backend(VertexLayout::Tracer);
+	const std::vector<TracerVertex>& tracer_vertices = simulation.getSnapshot().vertices;
+	StreamingVertexBuffer<TracerVertex> tracing_vertex_buffer(&tracing_backend, tracer_vertices.data(), tracer_vertices.size());
+	IndexBuffer tracing_index_buffer(tracer_indices.data(), static_cast<uint32>(tracer_indices.size()), sizeof(tracer_indices[0]));
+	glEnable(GL_PRIMITIVE_RESTART_FIXED_INDEX);
 
 	Shader shader("shader/basic.vert", "shader/basic.frag");
+	Shader tracer_shader("shader/tracer.vert", "shader/basic.frag");
 	shader.bind();
 
 	Model heli_model;
@@ -287,6 +167,11 @@ int main(int argc, char** argv) {
 	
 	glUniformMatrix4fv(shader.get_location("u_mvp"), 1, GL_FALSE, &model[0][0]);
 		
+#ifndef _RELEASE
+	PROFILE_THREAD_NAME("render");
+	ProfileSummary profile_summary;
+#endif
+
 	uint64 perfCounterFrequency = SDL_GetPerformanceFrequency();
 	uint64 lastCounter = SDL_GetPerformanceCounter();
 	float delta = 0.0f;
@@ -295,7 +180,6 @@ int main(int argc, char** argv) {
 	bool button_a = false;
 	bool button_s = false;
 	bool button_d = false;
-	bool button_n = false;
 	bool button_h = false;
 	bool button_c = false;
 	bool button_q = false;
@@ -304,8 +188,6 @@ int main(int argc, char** argv) {
 	bool button_space = false;
 	float camera_speed = 10.0f;
 	float time = 0.0f;
-	float flow_delta = 0.0f;
-	float radius = 5.95f;
 	//glEnable(GL_CULL_FACE); // rotor blades do not get drawn correctly, their front face is down so the up part is dropped
 	glEnable(GL_DEPTH_TEST);
 	while (!close) {
@@ -334,30 +216,10 @@ int main(int argc, char** argv) {
 					button_d = true;
 					break;
 				case SDLK_n:
-					button_n = true;
+					simulation.step();
 					break;
 				case SDLK_r:
-					vertices.clear();
-					for (int i = 0; i < i_trace_count; i++)
-					{
-						for (int j = 0; j < j_trace_count; j++)
-						{
-							for (int k = 0; k < k_trace_count; k++)
-							{
-								for (int l = 0; l < l_trace_count; l++)
-								{
-									glm::vec3 position((tracing_width / 2.0f) - i * (tracing_width / i_trace_count) + 0.1f,
-										(tracing_height / 2.0f) - k * (tracing_height / k_trace_count) - 0.1f * l + 0.1f,
-										(tracing_width / 2.0f) - j * (tracing_width / i_trace_count) + 0.1f);
-									Vertex top = { position,glm::vec4(0.0f, 0.0f, 1.0f, 1.0f) };
-									position.y = (tracing_height / 2.0f) - k * (tracing_height / k_trace_count) - 0.1f * (l + 1.0f) + 0.1f;
-									Vertex bottom = { position,glm::vec4(1.0f, 0.0f, 0.0f, 1.0f) };
-									vertices.push_back(top);
-									vertices.push_back(bottom);
-								}
-							}
-						}
-					}
+					simulation.reset();
 					break;
 				case SDLK_c:
 					button_c = !button_c;
@@ -367,21 +229,7 @@ int main(int argc, char** argv) {
 					break;
 				case SDLK_q:
 					button_q = !button_q;
-					for (int i = 0; i < i_trace_count; i++)
-					{
-						for (int j = 0; j < j_trace_count; j++)
-						{
-							for (int k = 0; k < k_trace_count; k++)
-							{
-								int index = l_trace_count * 2.0f * k + (l_trace_count * k_trace_count * 2.0f) * j + (l_trace_count * k_trace_count * j_trace_count * 2.0f) * i;
-								for (int l = 0; l < l_trace_count; l++)
-								{
-									vertices[index + l * 2.0f].position.z /= (tracing_width);
-									vertices[index + l * 2.0f + 1].position.z /= (tracing_width);
-								}
-							}
-						}
-					}
+					simulation.flatten();
 					break;
 				case SDLK_SPACE:
 					button_space = !button_space;
@@ -461,63 +309,161 @@ int main(int argc, char** argv) {
 		//model = glm::scale(model, glm::vec3(1.0f));
 		//model = glm::rotate(model, 1.0f * delta, glm::vec3(0.0f, 1.0f, 0.0f));
 		glm::mat4 mvp = camera.getVP() * model;
+		shader.bind();
 		glUniformMatrix4fv(shader.get_location("u_mvp"), 1, GL_FALSE, &mvp[0][0]);
+		tracer_shader.bind();
+		glUniformMatrix4fv(tracer_shader.get_location("u_mvp"), 1, GL_FALSE, &mvp[0][0]);
 		
 		glClearColor(1.0f, 1.0f, 1.0f, 1.0f);
 		glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
 
 		// does not run at start, space play/pauses execution, n is one step forward, r resets the particles, q maps to 2D
-		if ((flow_delta > 0.1f && button_space) || button_n)
+		simulation_settings.running = button_space;
+		simulation_settings.view.view_projection = mvp;
+		simulation_settings.view.camera_position = camera.getPosition();
+		simulation.setSettings(simulation_settings);
+		{
+			PROFILE_SCOPE("upload");
+			// an export reads the current snapshot, the simulation keeps stepping into the other buffers meanwhile
+			if (!streamline_exporter.isBusy() && simulation.update_snapshot())
+			{
+				tracing_vertex_buffer.invalidate_all();
+			}
+			// only uploads when a new snapshot arrived since the drawn region was written
+			tracing_vertex_buffer.upload(simulation.getSnapshot().vertices.data());
+		}
 		{
-			std::thread threads[i_trace_count];
-			button_n = false;
-			flow_delta = 0.0f;
-			for (int i = 0; i < i_trace_count; i++)
+			PROFILE_SCOPE("draw");
+			tracing_vertex_buffer.bind();
+			tracing_index_buffer.bind();
+			glLineWidth(line_width);
+			glDrawElementsBaseVertex(GL_LINE_STRIP, static_cast<GLsizei>(tracing_index_buffer.getNum_indices()), GL_UNSIGNED_INT, 0,
+				static_cast<GLint>(tracing_vertex_buffer.getFirst_vertex()));
+			tracing_vertex_buffer.fence();
+			shader.bind();
+
+			if (button_h)
 			{
-				threads[i] = std::thread(calculate_new_positions, i, j_trace_count, k_trace_count, l_trace_count, &vertices, radius);
+				heli_model.render();
 			}
-			for (int i = 0; i < i_trace_count; i++)
+			if (button_c)
 			{
-				threads[i].join();
+				coordinate_vertex_buffer.bind();
+				glDrawArrays(GL_LINES, 0, coordinate_vertex_buffer.getNum_vertices());
 			}
 		}
-		tracing_vertex_buffer.update(vertices);
-		glLineWidth(line_width);
-		glDrawArrays(GL_LINES, 0, tracing_vertex_buffer.getNum_vertices());
 
-		if (button_h)
-		{
-			heli_model.render();
-		}
-		if (button_c)
+		// imgui window
 		{
-			coordinate_vertex_buffer.bind();
-			glDrawArrays(GL_LINES, 0, coordinate_vertex_buffer.getNum_vertices());
+			PROFILE_SCOPE("imgui");
+			ImGui_ImplOpenGL3_NewFrame();
+			ImGui_ImplSDL2_NewFrame(window);
+			ImGui::NewFrame();
+			static int counter = 0;
+
+			ImGui::Begin("Controls");
+			ImGui::SliderFloat("Vortex Ring", &simulation_settings.radius, 0.0f, 11.9f);//8.925f);
+			ImGui::Checkbox("Baked Field", &simulation_settings.use_grid);
+			ImGui::SameLine();
+			ImGui::Checkbox("Tricubic", &simulation_settings.tricubic);
+			const char* integrators[] = { "Euler", "RK2", "RK4", "RK45" };
+			int integrator_index = static_cast<int>(simulation_settings.integrator.integrator);
+			if (ImGui::Combo("Integrator", &integrator_index, integrators, 4))
+			{
+				simulation_settings.integrator.integrator = static_cast<Integrator>(integrator_index);
+			}
+			// higher order integrators stay accurate with far larger steps
+			ImGui::SliderFloat("Step Size", &simulation_settings.step_size, 0.001f, 0.1f, "%.3f");
+			ImGui::Checkbox("Tracer LOD", &simulation_settings.lod.enabled);
+			if (simulation_settings.lod.enabled)
+			{
+				ImGui::SameLine();
+				ImGui::Checkbox("Freeze Off Screen", &simulation_settings.lod.freeze_offscreen);
+				ImGui::SliderFloat("Step Budget", &simulation_settings.lod.budget_ms, 0.0f, 50.0f, "%.1f ms");
+				ImGui::SliderFloat("Full Rate Distance", &simulation_settings.lod.near_distance, 1.0f, 100.0f);
+				ImGui::Text("LOD %zu of %zu tracers per step, budget level %d", simulation.getUpdated_count(), simulation.getSnapshot().tracer_count, simulation.getLod_bias());
+			}
+			bool recording = simulation.isRecording();
+			if (ImGui::Checkbox("Record", &recording))
+			{
+				if (recording) simulation.record(trajectory_path);
+				else simulation.stop_recording();
+			}
+			ImGui::SameLine();
+			bool replaying = simulation.isReplaying();
+			if (ImGui::Checkbox("Replay", &replaying))
+			{
+				if (replaying) simulation.replay(trajectory_path);
+				else simulation.stop_replay();
+			}
+			if (simulation.isRecording())
+			{
+				ImGui::Text("Recorded %llu frames to %s", static_cast<unsigned long long>(simulation.getRecorded_frames()), trajectory_path);
+			}
+			if (simulation.isReplaying())
+			{
+				// space plays the frames, n steps through them
+				int frame = static_cast<int>(simulation.getReplay_frame());
+				if (ImGui::SliderInt("Frame", &frame, 0, static_cast<int>(simulation.getReplay_frame_count()) - 1))
+				{
+					simulation.seek_replay(static_cast<uint64>(frame));
+				}
+			}
+			const char* export_formats[] = { "Binary", "CSV", "VTK Legacy", "VTK XML" };
+			ImGui::Combo("Export Format", &export_format, export_formats, 4);
+			if (streamline_exporter.isBusy())
+			{
+				ImGui::Text("Exporting streamlines...");
+			}
+			else if (ImGui::Button("Export Streamlines"))
+			{
+				StreamlineFormat format = static_cast<StreamlineFormat>(export_format);
+				std::string path = std::string("streamlines.") + streamline_format_name(format);
+				const TracerSnapshot& snapshot = simulation.getSnapshot();
+				streamline_exporter.start(path, format, streamline_source(snapshot.vertices, snapshot.tracer_count, snapshot.trail_length));
+			}
+			if (simulation.isBaking())
+			{
+				ImGui::Text("Baking velocity field... %d/%d keyframes", simulation.getBaked_keyframes(), simulation.getKeyframe_count());
+			}
+			ImGui::Text("Simulation %.3f ms/step, step %llu", simulation.getStep_ms(), static_cast<unsigned long long>(simulation.getSnapshot().step));
+			ImGui::Text("Application average %.3f ms/frame (%.1f FPS)", 1000.0f / ImGui::GetIO().Framerate, ImGui::GetIO().Framerate);
+#ifndef _RELEASE
+			if (ImGui::CollapsingHeader("Profiler"))
+			{
+				// rates over the last second, ms/s is summed over the threads running the timer
+				for (const ProfileSummary::TimerRate& timer : profile_summary.getTimers())
+				{
+					ImGui::Text("%-8s %8.3f ms %8.1f /s %8.1f ms/s", timer.name.c_str(), timer.ms_per_call, timer.calls_per_second, timer.ms_per_second);
+				}
+				for (int c = 0; c < static_cast<int>(ProfileCounter::Count); c++)
+				{
+					ProfileCounter profile_counter = static_cast<ProfileCounter>(c);
+					ImGui::Text("%-17s %12.0f /frame %14.0f /s", profile_counter_name(profile_counter),
+						profile_summary.getCounter_per_frame(profile_counter), profile_summary.getCounter_rate(profile_counter));
+				}
+				if (ImGui::Button("Export Trace"))
+				{
+					profiler().write_chrome_trace("trace.json");
+				}
+			}
+#endif
+			ImGui::End();
+			ImGui::Render();
+			ImGui_ImplOpenGL3_RenderDrawData(ImGui::GetDrawData());
 		}
 
-		// imgui window
-		ImGui_ImplOpenGL3_NewFrame();
-		ImGui_ImplSDL2_NewFrame(window);
-		ImGui::NewFrame();
-		static int counter = 0;
-
-		ImGui::Begin("Controls");
-		ImGui::SliderFloat("Vortex Ring", &radius, 0.0f, 11.9f);//8.925f);
-		ImGui::Text("Application average %.3f ms/frame (%.1f FPS)", 1000.0f / ImGui::GetIO().Framerate, ImGui::GetIO().Framerate);
-		ImGui::End();
-		ImGui::Render();
-		ImGui_ImplOpenGL3_RenderDrawData(ImGui::GetDrawData());
-
 		SDL_GL_SwapWindow(window);
 
-		flow_delta += delta;
 		time += delta;
 		uint64 endCounter = SDL_GetPerformanceCounter();
 		uint64 counterElapsed = endCounter - lastCounter;
 		delta = (float)counterElapsed / (float)perfCounterFrequency;
-		uint32 FPS = (uint32)((float)perfCounterFrequency / (float)counterElapsed);
-		std::cout << FPS << std::endl;
 		lastCounter = endCounter;
+#ifndef _RELEASE
+		profile_summary.update();
+		profiler().sample_counters();
+#endif
 	}
 	return 0;
 }
\ No newline at end of file
@@ -0,0 +1,106 @@
+#pragma once
+#include <iostream>
+
+#ifdef _WIN32
+#define NOMINMAX
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+#include "defines.h"
+
+// read only view of a whole file, the pages are loaded by the os on first access
+class MappedFile
+{
+public:
+	MappedFile() {}
+	MappedFile(const MappedFile&) = delete;
+	MappedFile& operator=(const MappedFile&) = delete;
+
+	virtual ~MappedFile()
+	{
+		close();
+	}
+
+	bool open(const char* path)
+	{
+		close();
+#ifdef _WIN32
+		file = CreateFileA(path, GENERIC_READ, FILE_SHARE_READ, nullptr, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, nullptr);
+		if (file == INVALID_HANDLE_VALUE)
+		{
+			std::cout << "Could not open " << path << std::endl;
+			return false;
+		}
+		LARGE_INTEGER file_size;
+		GetFileSizeEx(file, &file_size);
+		bytes = static_cast<uint64>(file_size.QuadPart);
+		if (bytes == 0) return true;
+		mapping = CreateFileMappingA(file, nullptr, PAGE_READONLY, 0, 0, nullptr);
+		if (mapping) memory = MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, 0);
+#else
+		int fd = ::open(path, O_RDONLY);
+		if (fd < 0)
+		{
+			std::cout << "Could not open " << path << std::endl;
+			return false;
+		}
+		struct stat info;
+		fstat(fd, &info);
+		bytes = static_cast<uint64>(info.st_size);
+		if (bytes == 0)
+		{
+			::close(fd);
+			return true;
+		}
+		memory = mmap(nullptr, bytes, PROT_READ, MAP_PRIVATE, fd, 0);
+		// the mapping keeps its own reference to the file
+		::close(fd);
+		if (memory == MAP_FAILED) memory = nullptr;
+#endif
+		if (!memory)
+		{
+			std::cout << "Could not map " << path << std::endl;
+			close();
+			return false;
+		}
+		return true;
+	}
+
+	void close()
+	{
+#ifdef _WIN32
+		if (memory) UnmapViewOfFile(memory);
+		if (mapping) CloseHandle(mapping);
+		if (file != INVALID_HANDLE_VALUE) CloseHandle(file);
+		mapping = nullptr;
+		file = INVALID_HANDLE_VALUE;
+#else
+		if (memory) munmap(memory, bytes);
+#endif
+		memory = nullptr;
+		bytes = 0;
+	}
+
+	const uint8* data() const
+	{
+		return static_cast<const uint8*>(memory);
+	}
+
+	uint64 size() const
+	{
+		return bytes;
+	}
+
+private:
+	void* memory = nullptr;
+	uint64 bytes = 0;
+#ifdef _WIN32
+	HANDLE file = INVALID_HANDLE_VALUE;
+	HANDLE mapping = nullptr;
+#endif
+};
@@ -0,0 +1,214 @@
+#pragma once
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+#include <unordered_map>
+#include <vector>
+
+#include "defines.h"
+
+// index buffer clean up for static meshes, used by the model converter
+
+// merges vertices with bitwise identical position and normal, rewrites the indices
+inline void weld_vertices(std::vector<ModelVertex>* vertices, std::vector<uint32>* indices)
+{
+	struct Key
+	{
+		uint32 bits[6];
+		bool operator==(const Key& other) const
+		{
+			return memcmp(bits, other.bits, sizeof(bits)) == 0;
+		}
+	};
+	struct KeyHash
+	{
+		size_t operator()(const Key& key) const
+		{
+			uint64 hash = 14695981039346656037ull;
+			for (uint32 b : key.bits) hash = (hash ^ b) * 1099511628211ull;
+			return static_cast<size_t>(hash);
+		}
+	};
+
+	std::unordered_map<Key, uint32, KeyHash> unique;
+	unique.reserve(vertices->size());
+	std::vector<ModelVertex> welded;
+	welded.reserve(vertices->size());
+	std::vector<uint32> remap(vertices->size());
+	for (size_t i = 0; i < vertices->size(); i++)
+	{
+		ModelVertex vertex = (*vertices)[i];
+		// -0 and 0 are the same vertex
+		for (int c = 0; c < 3; c++)
+		{
+			vertex.position[c] += 0.0f;
+			vertex.normal[c] += 0.0f;
+		}
+		Key key;
+		memcpy(&key.bits[0], &vertex.position.x, 3 * sizeof(float));
+		memcpy(&key.bits[3], &vertex.normal.x, 3 * sizeof(float));
+		auto it = unique.find(key);
+		if (it == unique.end())
+		{
+			it = unique.emplace(key, static_cast<uint32>(welded.size())).first;
+			welded.push_back(vertex);
+		}
+		remap[i] = it->second;
+	}
+	for (uint32& index : *indices) index = remap[index];
+	vertices->swap(welded);
+}
+
+// average cache misses per triangle for a fifo post transform cache, 0.5 is the best a closed mesh can get
+inline float vertex_cache_acmr(const std::vector<uint32>& indices, size_t vertex_count, int cache_size = 16)
+{
+	if (indices.empty()) return 0.0f;
+	std::vector<uint64> stamp(vertex_count, 0);
+	uint64 time = cache_size + 1;
+	uint64 misses = 0;
+	for (uint32 index : indices)
+	{
+		if (time - stamp[index] > static_cast<uint64>(cache_size))
+		{
+			stamp[index] = time++;
+			misses++;
+		}
+	}
+	return static_cast<float>(misses) / (indices.size() / 3);
+}
+
+// reorders the triangles for the post transform vertex cache, greedy after Tom Forsyth's linear speed optimizer
+// every vertex gets a score from its position in a simulated lru cache and from how many triangles still use it,
+// the next triangle is the one with the highest sum of its vertex scores
+inline void optimize_vertex_cache(std::vector<uint32>* indices, size_t vertex_count)
+{
+	const int cache_size = 32;
+	size_t triangle_count = indices->size() / 3;
+	if (triangle_count == 0) return;
+
+	auto score = [](int cache_position, uint32 remaining)
+	{
+		if (remaining == 0) return -1.0f;
+		float value = 0.0f;
+		if (cache_position >= 0)
+		{
+			// the last triangle's vertices get a fixed score so its neighbours are not preferred over strips
+			if (cache_position < 3) value = 0.75f;
+			else value = powf(1.0f - (cache_position - 3) / static_cast<float>(cache_size - 3), 1.5f);
+		}
+		// vertices with few triangles left get finished first
+		return value + 2.0f / sqrtf(static_cast<float>(remaining));
+	};
+
+	// triangles of each vertex
+	std::vector<uint32> remaining(vertex_count, 0);
+	for (uint32 index : *indices) remaining[index]++;
+	std::vector<uint32> adjacency_start(vertex_count + 1, 0);
+	for (size_t v = 0; v < vertex_count; v++) adjacency_start[v + 1] = adjacency_start[v] + remaining[v];
+	std::vector<uint32> adjacency(indices->size());
+	{
+		std::vector<uint32> fill(adjacency_start.begin(), adjacency_start.end() - 1);
+		for (size_t i = 0; i < indices->size(); i++) adjacency[fill[(*indices)[i]]++] = static_cast<uint32>(i / 3);
+	}
+
+	std::vector<int> cache_position(vertex_count, -1);
+	std::vector<float> vertex_score(vertex_count);
+	for (size_t v = 0; v < vertex_count; v++) vertex_score[v] = score(-1, remaining[v]);
+	std::vector<float> triangle_score(triangle_count);
+	for (size_t t = 0; t < triangle_count; t++)
+	{
+		const uint32* tri = &(*indices)[t * 3];
+		triangle_score[t] = vertex_score[tri[0]] + vertex_score[tri[1]] + vertex_score[tri[2]];
+	}
+	std::vector<bool> emitted(triangle_count, false);
+	std::vector<uint32> output;
+	output.reserve(indices->size());
+	std::vector<uint32> cache;
+	std::vector<uint32> next_cache;
+
+	size_t scan = 0;
+	int64 best = -1;
+	for (size_t n = 0; n < triangle_count; n++)
+	{
+		if (best < 0)
+		{
+			// nothing in the cache is connected to a remaining triangle, continue with the next one in input order
+			while (emitted[scan]) scan++;
+			best = static_cast<int64>(scan);
+		}
+		const uint32* tri = &(*indices)[best * 3];
+		output.insert(output.end(), tri, tri + 3);
+		emitted[best] = true;
+
+		// the triangle's vertices move to the front of the cache
+		next_cache.assign(tri, tri + 3);
+		for (uint32 v : cache)
+		{
+			if (v != tri[0] && v != tri[1] && v != tri[2]) next_cache.push_back(v);
+		}
+		for (int c = 0; c < 3; c++)
+		{
+			uint32 v = tri[c];
+			remaining[v]--;
+			// take the triangle out of the vertex's list of remaining ones
+			uint32* begin = &adjacency[adjacency_start[v]];
+			uint32* end = begin + remaining[v] + 1;
+			*std::find(begin, end, static_cast<uint32>(best)) = end[-1];
+		}
+		for (size_t i = cache_size; i < next_cache.size(); i++) cache_position[next_cache[i]] = -1;
+		if (next_cache.size() > static_cast<size_t>(cache_size)) next_cache.resize(cache_size);
+		cache.swap(next_cache);
+
+		// only the vertices that were or are in the cache changed score
+		for (size_t i = 0; i < cache.size(); i++) cache_position[cache[i]] = static_cast<int>(i);
+		auto rescore = [&](uint32 v)
+		{
+			float updated = score(cache_position[v], remaining[v]);
+			float delta = updated - vertex_score[v];
+			vertex_score[v] = updated;
+			for (uint32 a = adjacency_start[v]; a < adjacency_start[v] + remaining[v]; a++) triangle_score[adjacency[a]] += delta;
+		};
+		for (uint32 v : next_cache)
+		{
+			if (cache_position[v] < 0) rescore(v);
+		}
+		for (uint32 v : cache) rescore(v);
+
+		// and only their triangles are candidates for the next pick
+		best = -1;
+		float best_score = -1.0f;
+		for (uint32 v : cache)
+		{
+			for (uint32 a = adjacency_start[v]; a < adjacency_start[v] + remaining[v]; a++)
+			{
+				uint32 t = adjacency[a];
+				if (triangle_score[t] > best_score)
+				{
+					best_score = triangle_score[t];
+					best = t;
+				}
+			}
+		}
+	}
+	indices->swap(output);
+}
+
+// renumbers the vertices in the order the index buffer first uses them, so vertex fetches walk memory forward
+// vertices no triangle uses are dropped
+inline void optimize_vertex_fetch(std::vector<ModelVertex>* vertices, std::vector<uint32>* indices)
+{
+	const uint32 unused = 0xFFFFFFFF;
+	std::vector<uint32> remap(vertices->size(), unused);
+	std::vector<ModelVertex> ordered;
+	ordered.reserve(vertices->size());
+	for (uint32& index : *indices)
+	{
+		if (remap[index] == unused)
+		{
+			remap[index] = static_cast<uint32>(ordered.size());
+			ordered.push_back((*vertices)[index]);
+		}
+		index = remap[index];
+	}
+	vertices->swap(ordered);
+}
@@ -0,0 +1,267 @@
+// converts wavefront .obj and .mtl models to .bmf, one mesh per material
+// duplicate vertices are welded, triangles reordered for the vertex cache and vertices for fetch locality
+// only needs glm, build it from this file alone
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#include <sstream>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+#include "defines.h"
+#include "bmf.h"
+#include "mesh_optimizer.h"
+
+static void print_usage()
+{
+	std::cout << "usage: obj_to_bmf [options] input.obj output.bmf\n"
+		<< "  -s scale      multiplies every position, 0.3048 for models in feet (1)\n"
+		<< "  -c            keep the triangle and vertex order of the .obj\n";
+}
+
+static Material default_material()
+{
+	Material material;
+	material.diffuse = glm::vec3(0.8f, 0.8f, 0.8f);
+	material.specular = glm::vec3(0.0f, 0.0f, 0.0f);
+	material.emissive = glm::vec3(0.0f, 0.0f, 0.0f);
+	material.shininess = 0.0f;
+	return material;
+}
+
+static glm::vec3 read_vec3(std::istringstream& line)
+{
+	glm::vec3 v(0.0f, 0.0f, 0.0f);
+	line >> v.x >> v.y >> v.z;
+	return v;
+}
+
+// newmtl, Kd, Ks, Ke and Ns, everything else is ignored
+static bool load_mtl(const std::string& path, std::unordered_map<std::string, Material>* materials)
+{
+	std::ifstream input(path);
+	if (!input.is_open())
+	{
+		std::cout << "Could not open " << path << std::endl;
+		return false;
+	}
+	Material* current = nullptr;
+	std::string text;
+	while (std::getline(input, text))
+	{
+		std::istringstream line(text);
+		std::string keyword;
+		line >> keyword;
+		if (keyword == "newmtl")
+		{
+			std::string name;
+			std::getline(line >> std::ws, name);
+			current = &(*materials)[name];
+			*current = default_material();
+		}
+		else if (!current) continue;
+		else if (keyword == "Kd") current->diffuse = read_vec3(line);
+		else if (keyword == "Ks") current->specular = read_vec3(line);
+		else if (keyword == "Ke") current->emissive = read_vec3(line);
+		else if (keyword == "Ns") line >> current->shininess;
+	}
+	return true;
+}
+
+// obj indices start at 1, negative ones count back from the last element
+static bool resolve_index(const char* text, size_t count, int64* index)
+{
+	char* end;
+	long long value = strtoll(text, &end, 10);
+	if (end == text) return false;
+	*index = value < 0 ? static_cast<int64>(count) + value : value - 1;
+	return *index >= 0 && *index < static_cast<int64>(count);
+}
+
+struct ObjMesh
+{
+	std::string material;
+	std::vector<ModelVertex> vertices;
+	std::vector<uint32> indices;
+};
+
+// polygons are split into fans, faces without normals get the flat face normal
+static bool load_obj(const std::string& path, std::vector<ObjMesh>* meshes, std::unordered_map<std::string, Material>* materials)
+{
+	std::ifstream input(path);
+	if (!input.is_open())
+	{
+		std::cout << "Could not open " << path << std::endl;
+		return false;
+	}
+	std::string directory;
+	size_t slash = path.find_last_of("/\\");
+	if (slash != std::string::npos) directory = path.substr(0, slash + 1);
+
+	std::vector<glm::vec3> positions;
+	std::vector<glm::vec3> normals;
+	std::unordered_map<std::string, size_t> mesh_of_material;
+	size_t current = 0;
+	bool has_current = false;
+	std::vector<ModelVertex> face;
+	std::vector<bool> face_has_normal;
+
+	std::string text;
+	uint64 line_number = 0;
+	while (std::getline(input, text))
+	{
+		line_number++;
+		std::istringstream line(text);
+		std::string keyword;
+		line >> keyword;
+		if (keyword == "v") positions.push_back(read_vec3(line));
+		else if (keyword == "vn") normals.push_back(read_vec3(line));
+		else if (keyword == "mtllib")
+		{
+			std::string name;
+			std::getline(line >> std::ws, name);
+			if (!load_mtl(directory + name, materials)) return false;
+		}
+		else if (keyword == "usemtl" || (keyword == "f" && !has_current))
+		{
+			std::string name;
+			if (keyword == "usemtl") std::getline(line >> std::ws, name);
+			auto it = mesh_of_material.find(name);
+			if (it == mesh_of_material.end())
+			{
+				it = mesh_of_material.emplace(name, meshes->size()).first;
+				meshes->push_back(ObjMesh());
+				meshes->back().material = name;
+			}
+			current = it->second;
+			has_current = true;
+		}
+		if (keyword != "f") continue;
+
+		face.clear();
+		face_has_normal.clear();
+		std::string corner;
+		while (line >> corner)
+		{
+			// v, v/vt, v/vt/vn or v//vn
+			ModelVertex vertex;
+			int64 index;
+			if (!resolve_index(corner.c_str(), positions.size(), &index))
+			{
+				std::cout << path << ":" << line_number << ": bad vertex index " << corner << std::endl;
+				return false;
+			}
+			vertex.position = positions[index];
+			vertex.normal = glm::vec3(0.0f, 0.0f, 0.0f);
+			size_t first = corner.find('/');
+			size_t second = first == std::string::npos ? std::string::npos : corner.find('/', first + 1);
+			bool has_normal = second != std::string::npos && second + 1 < corner.size();
+			if (has_normal)
+			{
+				if (!resolve_index(corner.c_str() + second + 1, normals.size(), &index))
+				{
+					std::cout << path << ":" << line_number << ": bad normal index " << corner << std::endl;
+					return false;
+				}
+				vertex.normal = normals[index];
+			}
+			face.push_back(vertex);
+			face_has_normal.push_back(has_normal);
+		}
+		if (face.size() < 3)
+		{
+			std::cout << path << ":" << line_number << ": face with less than three vertices" << std::endl;
+			return false;
+		}
+		glm::vec3 face_normal = glm::cross(face[1].position - face[0].position, face[2].position - face[0].position);
+		float length = glm::length(face_normal);
+		if (length > 0.0f) face_normal /= length;
+		for (size_t i = 0; i < face.size(); i++)
+		{
+			if (!face_has_normal[i]) face[i].normal = face_normal;
+		}
+
+		ObjMesh& mesh = (*meshes)[current];
+		uint32 base = static_cast<uint32>(mesh.vertices.size());
+		mesh.vertices.insert(mesh.vertices.end(), face.begin(), face.end());
+		for (uint32 i = 1; i + 1 < face.size(); i++)
+		{
+			mesh.indices.push_back(base);
+			mesh.indices.push_back(base + i);
+			mesh.indices.push_back(base + i + 1);
+		}
+	}
+	return true;
+}
+
+int main(int argc, char** argv)
+{
+	float scale = 1.0f;
+	bool optimize = true;
+	std::vector<const char*> paths;
+	for (int i = 1; i < argc; i++)
+	{
+		if (!strcmp(argv[i], "-s") && i + 1 < argc) scale = static_cast<float>(atof(argv[++i]));
+		else if (!strcmp(argv[i], "-c")) optimize = false;
+		else if (argv[i][0] == '-')
+		{
+			print_usage();
+			return 1;
+		}
+		else paths.push_back(argv[i]);
+	}
+	if (paths.size() != 2)
+	{
+		print_usage();
+		return 1;
+	}
+
+	std::vector<ObjMesh> obj_meshes;
+	std::unordered_map<std::string, Material> materials;
+	if (!load_obj(paths[0], &obj_meshes, &materials)) return 1;
+
+	std::vector<BmfMeshData> meshes;
+	uint64 corners = 0;
+	uint64 vertices = 0;
+	uint64 triangles = 0;
+	uint64 misses_before = 0;
+	uint64 misses_after = 0;
+	for (ObjMesh& obj_mesh : obj_meshes)
+	{
+		if (obj_mesh.indices.empty()) continue;
+		BmfMeshData mesh;
+		auto material = materials.find(obj_mesh.material);
+		if (material != materials.end()) mesh.material = material->second;
+		else
+		{
+			if (!obj_mesh.material.empty()) std::cout << "Material " << obj_mesh.material << " not found, using the default" << std::endl;
+			mesh.material = default_material();
+		}
+		corners += obj_mesh.vertices.size();
+		mesh.vertices.swap(obj_mesh.vertices);
+		mesh.indices.swap(obj_mesh.indices);
+		for (ModelVertex& vertex : mesh.vertices) vertex.position *= scale;
+
+		weld_vertices(&mesh.vertices, &mesh.indices);
+		size_t mesh_triangles = mesh.indices.size() / 3;
+		misses_before += static_cast<uint64>(vertex_cache_acmr(mesh.indices, mesh.vertices.size()) * mesh_triangles + 0.5f);
+		if (optimize)
+		{
+			optimize_vertex_cache(&mesh.indices, mesh.vertices.size());
+			optimize_vertex_fetch(&mesh.vertices, &mesh.indices);
+		}
+		misses_after += static_cast<uint64>(vertex_cache_acmr(mesh.indices, mesh.vertices.size()) * mesh_triangles + 0.5f);
+		vertices += mesh.vertices.size();
+		triangles += mesh_triangles;
+		meshes.push_back(std::move(mesh));
+	}
+	if (!write_bmf(paths[1], meshes)) return 1;
+
+	printf("%s: %zu meshes, %llu triangles, %llu of %llu vertices after welding, acmr %.3f -> %.3f\n", paths[1], meshes.size(),
+		(unsigned long long) triangles, (unsigned long long) vertices, (unsigned long long) corners,
+		triangles ? static_cast<double>(misses_before) / triangles : 0.0, triangles ? static_cast<double>(misses_after) / triangles : 0.0);
+	return 0;
+}
@@ -0,0 +1,95 @@
+#pragma once
+#include <vector>
+
+#include "glm.hpp"
+#include "defines.h"
+
+// simulation state of the tracers, one contiguous float array per component so a step only streams 12 bytes per particle
+// age, lifetime and the seed positions stay empty unless the particles expire
+struct ParticleStore
+{
+	size_t count = 0;
+	std::vector<float> x;
+	std::vector<float> y;
+	std::vector<float> z;
+	std::vector<float> age;
+	std::vector<float> lifetime;
+	std::vector<float> seed_x; // respawn positions
+	std::vector<float> seed_y;
+	std::vector<float> seed_z;
+	std::vector<float> step; // substep size of the adaptive integrator, carried between simulation steps
+};
+
+inline void init_particles(ParticleStore* particles, size_t count)
+{
+	particles->count = count;
+	particles->x.assign(count, 0.0f);
+	particles->y.assign(count, 0.0f);
+	particles->z.assign(count, 0.0f);
+	particles->age.clear();
+	particles->lifetime.clear();
+	particles->seed_x.clear();
+	particles->seed_y.clear();
+	particles->seed_z.clear();
+	particles->step.clear();
+}
+
+inline glm::vec3 particle_position(const ParticleStore& particles, size_t i)
+{
+	return glm::vec3(particles.x[i], particles.y[i], particles.z[i]);
+}
+
+inline void set_particle_position(ParticleStore* particles, size_t i, const glm::vec3& position)
+{
+	particles->x[i] = position.x;
+	particles->y[i] = position.y;
+	particles->z[i] = position.z;
+}
+
+// every particle starts at the given substep size, without this the adaptive integrator starts over each step
+inline void enable_adaptive_step(ParticleStore* particles, float initial)
+{
+	particles->step.assign(particles->count, initial);
+}
+
+inline bool has_lifetime(const ParticleStore& particles)
+{
+	return !particles.lifetime.empty();
+}
+
+// particles respawn at their current position once they are lifetime old,
+// the starting ages are staggered so they do not all respawn in the same step
+inline void enable_lifetime(ParticleStore* particles, float lifetime)
+{
+	particles->seed_x = particles->x;
+	particles->seed_y = particles->y;
+	particles->seed_z = particles->z;
+	particles->lifetime.assign(particles->count, lifetime);
+	particles->age.resize(particles->count);
+	for (size_t i = 0; i < particles->count; i++)
+	{
+		float fraction = static_cast<float>(i) * 0.618034f;
+		particles->age[i] = (fraction - static_cast<float>(static_cast<uint64>(fraction))) * lifetime;
+	}
+}
+
+// ages particle i by dt and moves it back to its seed once expired, its age becomes exactly 0
+inline void age_particle(ParticleStore* particles, size_t i, float dt)
+{
+	float age = particles->age[i] + dt;
+	if (age >= particles->lifetime[i])
+	{
+		particles->x[i] = particles->seed_x[i];
+		particles->y[i] = particles->seed_y[i];
+		particles->z[i] = particles->seed_z[i];
+		age = 0.0f;
+	}
+	particles->age[i] = age;
+}
+
+// ages the particles [begin, end) by dt
+inline void age_particles(size_t begin, size_t end, ParticleStore* particles, float dt)
+{
+	if (!has_lifetime(*particles)) return;
+	for (size_t i = begin; i < end; i++) age_particle(particles, i, dt);
+}
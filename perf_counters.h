@@ -0,0 +1,162 @@
+#pragma once
+// hardware performance counters through linux perf_event_open, for the benchmark and headless runs
+// every counter is opened on its own, so a cpu or vm without one of them still reports the others
+// the counters follow the calling thread and every thread it starts after open, create thread pools after open
+// elsewhere, or when the kernel refuses (perf_event_paranoid, containers), open returns false and nothing is counted
+#include <cstring>
+#include <iostream>
+
+#ifdef __linux__
+#include <linux/perf_event.h>
+#include <sys/ioctl.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#endif
+
+#include "defines.h"
+
+enum class HardwareCounter
+{
+	Cycles,
+	Instructions,
+	BranchMisses,
+	L1dMisses, // level 1 data cache read misses
+	LlcMisses, // last level cache misses
+	Count
+};
+
+inline const char* hardware_counter_name(HardwareCounter counter)
+{
+	switch (counter)
+	{
+	case HardwareCounter::Cycles: return "cycles";
+	case HardwareCounter::Instructions: return "instructions";
+	case HardwareCounter::BranchMisses: return "branch_misses";
+	case HardwareCounter::L1dMisses: return "l1d_misses";
+	case HardwareCounter::LlcMisses: return "llc_misses";
+	default: return "";
+	}
+}
+
+const int HARDWARE_COUNTER_COUNT = static_cast<int>(HardwareCounter::Count);
+
+// counts of one measurement, a counter the machine does not have stays unavailable
+struct CounterValues
+{
+	bool available[HARDWARE_COUNTER_COUNT] = {};
+	double values[HARDWARE_COUNTER_COUNT] = {};
+};
+
+class PerfCounters
+{
+public:
+	PerfCounters()
+	{
+		for (int& fd : fds) fd = -1;
+	}
+	PerfCounters(const PerfCounters&) = delete;
+	PerfCounters& operator=(const PerfCounters&) = delete;
+
+	virtual ~PerfCounters()
+	{
+		close();
+	}
+
+	// opens the counters stopped, false if none of them could be opened
+	bool open()
+	{
+		close();
+#ifdef __linux__
+		for (int c = 0; c < HARDWARE_COUNTER_COUNT; c++)
+		{
+			perf_event_attr attr;
+			memset(&attr, 0, sizeof(attr));
+			attr.size = sizeof(attr);
+			attr.disabled = 1;
+			attr.inherit = 1;
+			// user space only, allowed up to perf_event_paranoid 2
+			attr.exclude_kernel = 1;
+			attr.exclude_hv = 1;
+			// more counters than the pmu has get multiplexed, the times let read scale them back up
+			attr.read_format = PERF_FORMAT_TOTAL_TIME_ENABLED | PERF_FORMAT_TOTAL_TIME_RUNNING;
+			switch (static_cast<HardwareCounter>(c))
+			{
+			case HardwareCounter::Cycles:
+				attr.type = PERF_TYPE_HARDWARE;
+				attr.config = PERF_COUNT_HW_CPU_CYCLES;
+				break;
+			case HardwareCounter::Instructions:
+				attr.type = PERF_TYPE_HARDWARE;
+				attr.config = PERF_COUNT_HW_INSTRUCTIONS;
+				break;
+			case HardwareCounter::BranchMisses:
+				attr.type = PERF_TYPE_HARDWARE;
+				attr.config = PERF_COUNT_HW_BRANCH_MISSES;
+				break;
+			case HardwareCounter::L1dMisses:
+				attr.type = PERF_TYPE_HW_CACHE;
+				attr.config = PERF_COUNT_HW_CACHE_L1D | (PERF_COUNT_HW_CACHE_OP_READ << 8) | (PERF_COUNT_HW_CACHE_RESULT_MISS << 16);
+				break;
+			default:
+				attr.type = PERF_TYPE_HARDWARE;
+				attr.config = PERF_COUNT_HW_CACHE_MISSES;
+				break;
+			}
+			fds[c] = static_cast<int>(syscall(SYS_perf_event_open, &attr, 0, -1, -1, 0));
+		}
+#endif
+		for (int fd : fds)
+		{
+			if (fd >= 0) return true;
+		}
+		std::cerr << "Hardware counters are not available (perf_event_open failed), reporting wall time only" << std::endl;
+		return false;
+	}
+
+	void close()
+	{
+#ifdef __linux__
+		for (int& fd : fds)
+		{
+			if (fd >= 0) ::close(fd);
+			fd = -1;
+		}
+#endif
+	}
+
+	// zeroes and starts the counters
+	void start()
+	{
+#ifdef __linux__
+		for (int fd : fds)
+		{
+			if (fd < 0) continue;
+			ioctl(fd, PERF_EVENT_IOC_RESET, 0);
+			ioctl(fd, PERF_EVENT_IOC_ENABLE, 0);
+		}
+#endif
+	}
+
+	// stops the counters and returns the counts since start
+	CounterValues stop()
+	{
+		CounterValues result;
+#ifdef __linux__
+		for (int fd : fds)
+		{
+			if (fd >= 0) ioctl(fd, PERF_EVENT_IOC_DISABLE, 0);
+		}
+		for (int c = 0; c < HARDWARE_COUNTER_COUNT; c++)
+		{
+			uint64 data[3]; // value, time enabled, time running
+			if (fds[c] < 0 || read(fds[c], data, sizeof(data)) != static_cast<ssize_t>(sizeof(data)) || data[2] == 0) continue;
+			result.available[c] = true;
+			result.values[c] = static_cast<double>(data[0]) * (static_cast<double>(data[1]) / static_cast<double>(data[2]));
+		}
+#endif
+		return result;
+	}
+
+private:
+	int fds[HARDWARE_COUNTER_COUNT];
+};
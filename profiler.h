@@ -0,0 +1,397 @@
+#pragma once
+// counters and scoped timers for development builds, everything below compiles to nothing with _RELEASE defined
+// PROFILE_SCOPE("name") times the rest of the enclosing block, the name has to be a string literal, nullptr times nothing
+// PROFILE_COUNT(ProfileCounter::X) counts one call on the calling thread, PROFILE_ADD(ProfileCounter::X, n) counts n
+// keep both out of the per-point kernels, a count costs a thread_local lookup, add a chunk's total once instead
+// every thread writes only its own counters and events, readers take them with relaxed atomics or under the thread's lock
+#ifndef _RELEASE
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <cstring>
+#include <deque>
+#include <iostream>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+#endif
+
+#include "defines.h"
+
+enum class ProfileCounter
+{
+	FieldEvaluations,     // velocity samples of calculate_new_positions, analytic or from a baked grid
+	PotentialEvaluations, // scene potentials behind the analytic ones, a grid sample needs none
+	IntegrationSteps,     // particle steps of calculate_new_positions, an rk45 step counts once however many substeps it takes
+	Count
+};
+
+inline const char* profile_counter_name(ProfileCounter counter)
+{
+	switch (counter)
+	{
+	case ProfileCounter::FieldEvaluations: return "field";
+	case ProfileCounter::PotentialEvaluations: return "potential";
+	case ProfileCounter::IntegrationSteps: return "integration steps";
+	default: return "";
+	}
+}
+
+#ifdef _RELEASE
+
+#define PROFILING 0
+#define PROFILE_SCOPE(name)
+#define PROFILE_COUNT(counter) ((void) 0)
+#define PROFILE_ADD(counter, n) ((void) 0)
+#define PROFILE_THREAD_NAME(name) ((void) 0)
+
+#else
+
+// tools that report timings print this, instrumented numbers are a few percent slower
+#define PROFILING 1
+#define PROFILE_CONCAT_(a, b) a##b
+#define PROFILE_CONCAT(a, b) PROFILE_CONCAT_(a, b)
+#define PROFILE_SCOPE(name) ProfileScope PROFILE_CONCAT(profile_scope_, __LINE__)(name)
+#define PROFILE_COUNT(counter) thread_profile().count(counter, 1)
+#define PROFILE_ADD(counter, n) thread_profile().count(counter, n)
+#define PROFILE_THREAD_NAME(name) thread_profile().setName(name)
+
+// one timed block for the trace, times in nanoseconds since the profiler started
+struct ProfileEvent
+{
+	const char* name;
+	uint64 start;
+	uint64 duration;
+};
+
+// counters, per timer totals and the latest events of one thread
+class ThreadProfile
+{
+public:
+	// the oldest events are overwritten once a thread recorded this many
+	static const size_t EVENT_CAPACITY = 1 << 16;
+	static const int TIMER_CAPACITY = 32;
+
+	struct Timer
+	{
+		std::atomic<const char*> name{ nullptr };
+		std::atomic<uint64> count{ 0 };
+		std::atomic<uint64> total{ 0 };
+	};
+
+	explicit ThreadProfile(uint32 id) : id(id), name("thread " + std::to_string(id))
+	{
+		for (std::atomic<uint64>& counter : counters) counter.store(0, std::memory_order_relaxed);
+	}
+
+	// only the owning thread writes, so a plain load and store is enough and avoids a locked add per call
+	void count(ProfileCounter counter, uint64 n)
+	{
+		std::atomic<uint64>& value = counters[static_cast<int>(counter)];
+		value.store(value.load(std::memory_order_relaxed) + n, std::memory_order_relaxed);
+	}
+
+	void record(const char* timer_name, uint64 start, uint64 duration)
+	{
+		Timer* timer = find_timer(timer_name);
+		if (timer)
+		{
+			timer->count.store(timer->count.load(std::memory_order_relaxed) + 1, std::memory_order_relaxed);
+			timer->total.store(timer->total.load(std::memory_order_relaxed) + duration, std::memory_order_relaxed);
+		}
+		std::lock_guard<std::mutex> lock(mutex);
+		if (events.size() < EVENT_CAPACITY) events.push_back(ProfileEvent{ timer_name, start, duration });
+		else events[event_head] = ProfileEvent{ timer_name, start, duration };
+		event_head = (event_head + 1) % EVENT_CAPACITY;
+	}
+
+	void setName(const std::string& thread_name)
+	{
+		std::lock_guard<std::mutex> lock(mutex);
+		name = thread_name;
+	}
+
+	uint64 getCounter(ProfileCounter counter) const
+	{
+		return counters[static_cast<int>(counter)].load(std::memory_order_relaxed);
+	}
+
+	uint32 getId() const
+	{
+		return id;
+	}
+
+	std::string getName()
+	{
+		std::lock_guard<std::mutex> lock(mutex);
+		return name;
+	}
+
+	// oldest first
+	std::vector<ProfileEvent> getEvents()
+	{
+		std::lock_guard<std::mutex> lock(mutex);
+		std::vector<ProfileEvent> ordered;
+		ordered.reserve(events.size());
+		size_t first = events.size() < EVENT_CAPACITY ? 0 : event_head;
+		for (size_t i = 0; i < events.size(); i++) ordered.push_back(events[(first + i) % events.size()]);
+		return ordered;
+	}
+
+	Timer timers[TIMER_CAPACITY];
+
+private:
+	// names are string literals, so the pointer identifies the timer within a thread
+	Timer* find_timer(const char* timer_name)
+	{
+		for (Timer& timer : timers)
+		{
+			const char* current = timer.name.load(std::memory_order_relaxed);
+			if (current == timer_name) return &timer;
+			if (!current)
+			{
+				timer.name.store(timer_name, std::memory_order_release);
+				return &timer;
+			}
+		}
+		return nullptr;
+	}
+
+	uint32 id;
+	std::atomic<uint64> counters[static_cast<int>(ProfileCounter::Count)];
+	std::mutex mutex;
+	std::string name;
+	std::vector<ProfileEvent> events;
+	size_t event_head = 0;
+};
+
+// every thread that ever profiled something, kept until exit so the trace still has threads that are gone
+class Profiler
+{
+public:
+	Profiler() : start(std::chrono::steady_clock::now()) {}
+
+	ThreadProfile* add_thread()
+	{
+		std::lock_guard<std::mutex> lock(mutex);
+		threads.emplace_back(new ThreadProfile(static_cast<uint32>(threads.size())));
+		return threads.back().get();
+	}
+
+	uint64 now() const
+	{
+		return static_cast<uint64>(std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - start).count());
+	}
+
+	std::vector<ThreadProfile*> getThreads()
+	{
+		std::lock_guard<std::mutex> lock(mutex);
+		std::vector<ThreadProfile*> result;
+		for (auto& thread : threads) result.push_back(thread.get());
+		return result;
+	}
+
+	uint64 total(ProfileCounter counter)
+	{
+		uint64 sum = 0;
+		for (ThreadProfile* thread : getThreads()) sum += thread->getCounter(counter);
+		return sum;
+	}
+
+	// chrome://tracing and ui.perfetto.dev json, one track per thread plus one per counter sampled with sample_counters
+	bool write_chrome_trace(const char* path)
+	{
+		FILE* file = fopen(path, "w");
+		if (!file)
+		{
+			std::cout << "Could not open " << path << " for writing" << std::endl;
+			return false;
+		}
+		fprintf(file, "{\"traceEvents\":[\n");
+		bool first = true;
+		auto separator = [&]() { if (!first) fprintf(file, ",\n"); first = false; };
+		for (ThreadProfile* thread : getThreads())
+		{
+			separator();
+			fprintf(file, "{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":1,\"tid\":%u,\"args\":{\"name\":\"%s\"}}", thread->getId(), thread->getName().c_str());
+			for (const ProfileEvent& event : thread->getEvents())
+			{
+				separator();
+				fprintf(file, "{\"name\":\"%s\",\"ph\":\"X\",\"pid\":1,\"tid\":%u,\"ts\":%.3f,\"dur\":%.3f}",
+					event.name, thread->getId(), event.start / 1000.0, event.duration / 1000.0);
+			}
+		}
+		{
+			std::lock_guard<std::mutex> lock(mutex);
+			for (const CounterSample& sample : samples)
+			{
+				for (int c = 0; c < static_cast<int>(ProfileCounter::Count); c++)
+				{
+					separator();
+					fprintf(file, "{\"name\":\"%s\",\"ph\":\"C\",\"pid\":1,\"ts\":%.3f,\"args\":{\"calls\":%llu}}",
+						profile_counter_name(static_cast<ProfileCounter>(c)), sample.time / 1000.0, static_cast<unsigned long long>(sample.values[c]));
+				}
+			}
+		}
+		fprintf(file, "\n],\"displayTimeUnit\":\"ms\"}\n");
+		bool ok = ferror(file) == 0;
+		fclose(file);
+		return ok;
+	}
+
+	// adds the summed counters to the trace's counter tracks, call once per frame or step
+	void sample_counters()
+	{
+		CounterSample sample;
+		sample.time = now();
+		for (int c = 0; c < static_cast<int>(ProfileCounter::Count); c++) sample.values[c] = total(static_cast<ProfileCounter>(c));
+		std::lock_guard<std::mutex> lock(mutex);
+		samples.push_back(sample);
+		if (samples.size() > ThreadProfile::EVENT_CAPACITY) samples.pop_front();
+	}
+
+private:
+	struct CounterSample
+	{
+		uint64 time;
+		uint64 values[static_cast<int>(ProfileCounter::Count)];
+	};
+
+	std::chrono::steady_clock::time_point start;
+	std::mutex mutex;
+	std::vector<std::unique_ptr<ThreadProfile>> threads;
+	std::deque<CounterSample> samples;
+};
+
+inline Profiler& profiler()
+{
+	static Profiler instance;
+	return instance;
+}
+
+inline ThreadProfile& thread_profile()
+{
+	static thread_local ThreadProfile* profile = profiler().add_thread();
+	return *profile;
+}
+
+class ProfileScope
+{
+public:
+	explicit ProfileScope(const char* name) : name(name), start(name ? profiler().now() : 0) {}
+
+	~ProfileScope()
+	{
+		if (name) thread_profile().record(name, start, profiler().now() - start);
+	}
+
+private:
+	const char* name;
+	uint64 start;
+};
+
+// per second rates over the last window, for the ui
+class ProfileSummary
+{
+public:
+	struct TimerRate
+	{
+		std::string name;
+		double calls_per_second;
+		double ms_per_call;
+		double ms_per_second; // summed over all threads, above 1000 means more than one busy thread
+	};
+
+	explicit ProfileSummary(double window = 1.0) : window(window) {}
+
+	// call once per frame, the per frame numbers assume that
+	void update()
+	{
+		Sample sample;
+		sample.time = profiler().now() * 1e-9;
+		for (int c = 0; c < static_cast<int>(ProfileCounter::Count); c++) sample.counters[c] = profiler().total(static_cast<ProfileCounter>(c));
+		for (ThreadProfile* thread : profiler().getThreads())
+		{
+			for (ThreadProfile::Timer& timer : thread->timers)
+			{
+				const char* name = timer.name.load(std::memory_order_acquire);
+				if (!name) break;
+				TimerTotal* total = nullptr;
+				for (TimerTotal& existing : sample.timers)
+				{
+					if (!strcmp(existing.name, name)) total = &existing;
+				}
+				if (!total)
+				{
+					sample.timers.push_back(TimerTotal{ name, 0, 0 });
+					total = &sample.timers.back();
+				}
+				total->count += timer.count.load(std::memory_order_relaxed);
+				total->total += timer.total.load(std::memory_order_relaxed);
+			}
+		}
+		history.push_back(sample);
+		while (history.size() > 2 && history.back().time - history[1].time >= window) history.pop_front();
+
+		rates.clear();
+		const Sample& oldest = history.front();
+		double elapsed = sample.time - oldest.time;
+		if (elapsed <= 0.0) elapsed = 1.0;
+		for (const TimerTotal& total : sample.timers)
+		{
+			uint64 count = total.count;
+			uint64 nanoseconds = total.total;
+			for (const TimerTotal& old : oldest.timers)
+			{
+				if (!strcmp(old.name, total.name))
+				{
+					count -= old.count;
+					nanoseconds -= old.total;
+				}
+			}
+			rates.push_back(TimerRate{ total.name, count / elapsed, count ? nanoseconds * 1e-6 / count : 0.0, nanoseconds * 1e-6 / elapsed });
+		}
+		for (int c = 0; c < static_cast<int>(ProfileCounter::Count); c++) counter_rates[c] = (sample.counters[c] - oldest.counters[c]) / elapsed;
+		frame_rate = (history.size() - 1) / elapsed;
+	}
+
+	const std::vector<TimerRate>& getTimers() const
+	{
+		return rates;
+	}
+
+	double getCounter_rate(ProfileCounter counter) const
+	{
+		return counter_rates[static_cast<int>(counter)];
+	}
+
+	// counter calls per frame at the current frame rate
+	double getCounter_per_frame(ProfileCounter counter) const
+	{
+		return frame_rate > 0.0 ? counter_rates[static_cast<int>(counter)] / frame_rate : 0.0;
+	}
+
+private:
+	struct TimerTotal
+	{
+		const char* name;
+		uint64 count;
+		uint64 total;
+	};
+
+	struct Sample
+	{
+		double time;
+		uint64 counters[static_cast<int>(ProfileCounter::Count)];
+		std::vector<TimerTotal> timers;
+	};
+
+	double window;
+	std::deque<Sample> history;
+	std::vector<TimerRate> rates;
+	double counter_rates[static_cast<int>(ProfileCounter::Count)] = {};
+	double frame_rate = 0.0;
+};
+
+#endif
@@ -0,0 +1,99 @@
+#pragma once
+#include <cstring>
+#include <vector>
+
+#include "defines.h"
+#include "buffer_backend.h"
+
+// BufferBackend without a graphics api, keeps the buffer in memory and logs every call
+// fences signal once release_fences is called, so buffer_check.cpp can play the gpu falling behind
+class RecordingBufferBackend : public BufferBackend
+{
+public:
+	enum class CallType { CreatePersistent, CreateDynamic, SubData, Fence, Wait, DeleteFence, Bind };
+
+	struct Call
+	{
+		CallType type;
+		uint64 offset;
+		uint64 bytes;
+		uint64 fence; // fence id for Fence, Wait and DeleteFence
+	};
+
+	explicit RecordingBufferBackend(bool persistent = true) : persistent(persistent) {}
+
+	void* create_persistent(uint64 bytes, const void* data) override
+	{
+		calls.push_back(Call{ CallType::CreatePersistent, 0, bytes, 0 });
+		if (!persistent) return nullptr;
+		allocate(bytes, data);
+		return memory.data();
+	}
+
+	void create_dynamic(uint64 bytes, const void* data) override
+	{
+		calls.push_back(Call{ CallType::CreateDynamic, 0, bytes, 0 });
+		allocate(bytes, data);
+	}
+
+	void sub_data(uint64 offset, uint64 bytes, const void* data) override
+	{
+		calls.push_back(Call{ CallType::SubData, offset, bytes, 0 });
+		memcpy(memory.data() + offset, data, bytes);
+	}
+
+	void* fence() override
+	{
+		fences.push_back(false);
+		calls.push_back(Call{ CallType::Fence, 0, 0, fences.size() });
+		return reinterpret_cast<void*>(static_cast<uintptr_t>(fences.size()));
+	}
+
+	// counts the waits on fences that had not signaled yet, those would have stalled the cpu
+	void wait(void* fence) override
+	{
+		uint64 id = reinterpret_cast<uintptr_t>(fence);
+		calls.push_back(Call{ CallType::Wait, 0, 0, id });
+		if (!fences[id - 1]) stalls++;
+		fences[id - 1] = true;
+	}
+
+	void delete_fence(void* fence) override
+	{
+		calls.push_back(Call{ CallType::DeleteFence, 0, 0, reinterpret_cast<uintptr_t>(fence) });
+	}
+
+	void bind() override
+	{
+		calls.push_back(Call{ CallType::Bind, 0, 0, 0 });
+	}
+
+	void release_fences()
+	{
+		for (size_t i = 0; i < fences.size(); i++) fences[i] = true;
+	}
+
+	uint64 count(CallType type) const
+	{
+		uint64 n = 0;
+		for (const Call& call : calls)
+		{
+			if (call.type == type) n++;
+		}
+		return n;
+	}
+
+	std::vector<Call> calls;
+	std::vector<uint8> memory;
+	std::vector<bool> fences;
+	uint64 stalls = 0;
+
+private:
+	void allocate(uint64 bytes, const void* data)
+	{
+		memory.assign(bytes, 0);
+		if (data) memcpy(memory.data(), data, bytes);
+	}
+
+	bool persistent;
+};
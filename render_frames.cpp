@@ -0,0 +1,178 @@
+// renders the tracer lines, and optionally the helicopter, to a png sequence on the cpu, for nodes without a gpu
+// only needs glm and stb_image_write, build it from this file alone
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <iostream>
+#include <string>
+#include <vector>
+
+#define STB_IMAGE_WRITE_IMPLEMENTATION
+#include "stb_image_write.h"
+// software_renderer.h includes the declarations again
+#undef STB_IMAGE_WRITE_IMPLEMENTATION
+#include "defines.h"
+#include "floating_camera.h"
+#include "bmf.h"
+#include "software_renderer.h"
+#include "thread_pool.h"
+#include "tracer.h"
+
+static void print_usage()
+{
+	std::cout << "usage: render_frames [options]\n"
+		<< "  -n i j k      tracer grid dimensions (15 15 15)\n"
+		<< "  -l count      trail length in line segments per tracer (20)\n"
+		<< "  -f frames     frames to render, the first one before any step (100)\n"
+		<< "  -s steps      simulation steps per frame (1)\n"
+		<< "  -d size       integration step size (0.005)\n"
+		<< "  -r radius     vortex ring radius, 0 to 11.9 (5.95)\n"
+		<< "  -g            sample a baked trilinear velocity grid instead of the analytic field\n"
+		<< "  -x w h        frame size in pixels (1280 800)\n"
+		<< "  -w width      line width in pixels (3)\n"
+		<< "  -c x y z      camera position, it looks along +z like the window's (0 0 -20)\n"
+		<< "  -m file       also draws this .bmf model\n"
+		<< "  -t threads    simulation and raster threads, 0 uses every hardware thread (0)\n"
+		<< "  -j threads    png encoder threads, 0 for a quarter of the hardware threads (0)\n"
+		<< "  -o pattern    printf pattern of the frame files (frame_%05d.png)\n";
+}
+
+int main(int argc, char** argv)
+{
+	int i_trace_count = 15;
+	int j_trace_count = 15;
+	int k_trace_count = 15;
+	int l_trace_count = 20;
+	int frames = 100;
+	int steps_per_frame = 1;
+	float step_size = 0.005f;
+	float radius = 5.95f;
+	bool use_grid = false;
+	int width = 1280;
+	int height = 800;
+	float line_width = 3.0f;
+	glm::vec3 camera_position(0.0f, 0.0f, -20.0f);
+	std::string model_path;
+	unsigned int thread_count = 0;
+	unsigned int png_thread_count = 0;
+	std::string pattern = "frame_%05d.png";
+	const float tracing_height = 8.0f;
+	const float tracing_width = 15.0f;
+
+	for (int a = 1; a < argc; a++)
+	{
+		if (strcmp(argv[a], "-n") == 0 && a + 3 < argc)
+		{
+			i_trace_count = atoi(argv[++a]);
+			j_trace_count = atoi(argv[++a]);
+			k_trace_count = atoi(argv[++a]);
+		}
+		else if (strcmp(argv[a], "-l") == 0 && a + 1 < argc) l_trace_count = atoi(argv[++a]);
+		else if (strcmp(argv[a], "-f") == 0 && a + 1 < argc) frames = atoi(argv[++a]);
+		else if (strcmp(argv[a], "-s") == 0 && a + 1 < argc) steps_per_frame = atoi(argv[++a]);
+		else if (strcmp(argv[a], "-d") == 0 && a + 1 < argc) step_size = static_cast<float>(atof(argv[++a]));
+		else if (strcmp(argv[a], "-r") == 0 && a + 1 < argc) radius = static_cast<float>(atof(argv[++a]));
+		else if (strcmp(argv[a], "-g") == 0) use_grid = true;
+		else if (strcmp(argv[a], "-x") == 0 && a + 2 < argc)
+		{
+			width = atoi(argv[++a]);
+			height = atoi(argv[++a]);
+		}
+		else if (strcmp(argv[a], "-w") == 0 && a + 1 < argc) line_width = static_cast<float>(atof(argv[++a]));
+		else if (strcmp(argv[a], "-c") == 0 && a + 3 < argc)
+		{
+			camera_position.x = static_cast<float>(atof(argv[++a]));
+			camera_position.y = static_cast<float>(atof(argv[++a]));
+			camera_position.z = static_cast<float>(atof(argv[++a]));
+		}
+		else if (strcmp(argv[a], "-m") == 0 && a + 1 < argc) model_path = argv[++a];
+		else if (strcmp(argv[a], "-t") == 0 && a + 1 < argc) thread_count = static_cast<unsigned int>(atoi(argv[++a]));
+		else if (strcmp(argv[a], "-j") == 0 && a + 1 < argc) png_thread_count = static_cast<unsigned int>(atoi(argv[++a]));
+		else if (strcmp(argv[a], "-o") == 0 && a + 1 < argc) pattern = argv[++a];
+		else
+		{
+			print_usage();
+			return 1;
+		}
+	}
+	if (i_trace_count <= 0 || j_trace_count <= 0 || k_trace_count <= 0 || l_trace_count <= 0 || frames < 0 || steps_per_frame < 0
+		|| width <= 0 || height <= 0 || !(line_width > 0.0f))
+	{
+		print_usage();
+		return 1;
+	}
+	if (png_thread_count == 0) png_thread_count = std::max(1u, std::thread::hardware_concurrency() / 4);
+
+	CompiledScene scene;
+	compile_scene(default_scene(), radius, &scene);
+	ParticleStore particles;
+	Trails trails;
+	init_tracers(&particles, &trails, i_trace_count, j_trace_count, k_trace_count, l_trace_count, tracing_width, tracing_height);
+	const size_t tracer_count = trails.tracer_count;
+	std::vector<TracerVertex> vertices(tracer_count * trails.length);
+
+	BmfFile model;
+	if (!model_path.empty() && !model.open(model_path.c_str())) return 1;
+
+	// the window's camera, 90 degrees and moved back along z
+	FloatingCamera camera(90.0f, static_cast<float>(width), static_cast<float>(height));
+	camera.translate(camera_position);
+	camera.update();
+	glm::mat4 view_projection = camera.getVP();
+
+	ThreadPool thread_pool(thread_count);
+	VelocityGrid grid;
+	if (use_grid)
+	{
+		grid.init(glm::vec3(-12.0f, -12.0f, -12.0f), glm::vec3(12.0f, 6.0f, 12.0f), 97, 73, 97);
+		grid.build(scene, thread_pool);
+	}
+	SoftwareRenderer renderer(width, height, &thread_pool);
+	PngSequenceWriter writer(pattern, width, height, png_thread_count);
+
+	double simulate_seconds = 0.0;
+	double render_seconds = 0.0;
+	auto start = std::chrono::steady_clock::now();
+	PROFILE_THREAD_NAME("main");
+	for (int frame = 0; frame < frames; frame++)
+	{
+		auto simulate_start = std::chrono::steady_clock::now();
+		for (int s = 0; frame > 0 && s < steps_per_frame; s++)
+		{
+			PROFILE_SCOPE("step");
+			thread_pool.parallel_for(tracer_count, 16, [&](size_t begin, size_t end)
+			{
+				calculate_new_positions(begin, end, &particles, scene, step_size, use_grid ? &grid : nullptr, GridInterpolation::Trilinear);
+				record_trails(begin, end, particles, &trails);
+			});
+		}
+		thread_pool.parallel_for(tracer_count, 256, [&](size_t begin, size_t end)
+		{
+			unroll_trails(begin, end, trails, &vertices);
+		});
+		auto render_start = std::chrono::steady_clock::now();
+		{
+			PROFILE_SCOPE("render");
+			renderer.clear(glm::vec4(1.0f, 1.0f, 1.0f, 1.0f));
+			for (uint32 m = 0; m < model.getMesh_count(); m++) renderer.draw_mesh(model.getMesh(m), view_projection);
+			renderer.draw_lines(vertices, tracer_count, trails.length, view_projection, line_width);
+			renderer.flush();
+		}
+		auto render_end = std::chrono::steady_clock::now();
+		simulate_seconds += std::chrono::duration<double>(render_start - simulate_start).count();
+		render_seconds += std::chrono::duration<double>(render_end - render_start).count();
+		writer.push(frame, renderer.getColor());
+	}
+	bool written = writer.finish();
+	double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+	std::cout << "frames: " << frames << ", " << width << "x" << height << ", tracers: " << tracer_count << ", threads: " << thread_pool.getThread_count()
+		<< " + " << png_thread_count << " png" << std::endl;
+	if (frames > 0)
+	{
+		std::cout << "simulate: " << 1000.0 * simulate_seconds / frames << " ms/frame, render: " << 1000.0 * render_seconds / frames << " ms/frame" << std::endl;
+	}
+	if (seconds > 0.0) std::cout << "total: " << seconds << " s, " << frames / seconds << " frames/s" << std::endl;
+	return written ? 0 : 1;
+}
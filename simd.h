@@ -0,0 +1,139 @@
+#pragma once
+// thin wrappers around the x86 vector registers so the batch kernels can be written once as templates
+// every instruction set is only visible in the translation unit that defines its CURL_NOISE_SIMD_* macro
+// and compiles with the matching target, see curl_noise_batch*.cpp
+
+#if defined(CURL_NOISE_SIMD_SSE) || defined(CURL_NOISE_SIMD_AVX2) || defined(CURL_NOISE_SIMD_AVX512)
+#include <immintrin.h>
+#endif
+
+// float and double are lanes of width one, the scalar and the reference path of curl_noise_lanes.h
+// kept out of the AVX translation units, an inline copy compiled there could be the one the linker keeps
+#if !defined(CURL_NOISE_SIMD_AVX2) && !defined(CURL_NOISE_SIMD_AVX512)
+#include <cmath>
+
+inline float simd_sqrt(float a) { return sqrtf(a); }
+inline float simd_min(float a, float b) { return a < b ? a : b; }
+inline float simd_max(float a, float b) { return a > b ? a : b; }
+inline float simd_select(bool m, float a, float b) { return m ? a : b; }
+inline double simd_sqrt(double a) { return sqrt(a); }
+inline double simd_min(double a, double b) { return a < b ? a : b; }
+inline double simd_max(double a, double b) { return a > b ? a : b; }
+inline double simd_select(bool m, double a, double b) { return m ? a : b; }
+inline bool simd_any(bool m) { return m; }
+inline bool simd_all(bool m) { return m; }
+#endif
+
+#ifdef CURL_NOISE_SIMD_SSE
+struct mask_sse
+{
+	__m128 m;
+};
+
+struct float_sse
+{
+	static const int width = 4;
+	typedef mask_sse mask;
+	__m128 v;
+
+	float_sse() : v(_mm_setzero_ps()) {}
+	float_sse(float f) : v(_mm_set1_ps(f)) {}
+	float_sse(__m128 m) : v(m) {}
+
+	static float_sse load(const float* p) { return _mm_loadu_ps(p); }
+	void store(float* p) const { _mm_storeu_ps(p, v); }
+};
+
+inline float_sse operator+(float_sse a, float_sse b) { return _mm_add_ps(a.v, b.v); }
+inline float_sse operator-(float_sse a, float_sse b) { return _mm_sub_ps(a.v, b.v); }
+inline float_sse operator*(float_sse a, float_sse b) { return _mm_mul_ps(a.v, b.v); }
+inline float_sse operator/(float_sse a, float_sse b) { return _mm_div_ps(a.v, b.v); }
+inline float_sse operator-(float_sse a) { return _mm_xor_ps(a.v, _mm_set1_ps(-0.0f)); }
+inline mask_sse operator<(float_sse a, float_sse b) { return { _mm_cmplt_ps(a.v, b.v) }; }
+inline mask_sse operator>(float_sse a, float_sse b) { return { _mm_cmpgt_ps(a.v, b.v) }; }
+inline mask_sse operator&(mask_sse a, mask_sse b) { return { _mm_and_ps(a.m, b.m) }; }
+inline mask_sse operator|(mask_sse a, mask_sse b) { return { _mm_or_ps(a.m, b.m) }; }
+inline float_sse simd_sqrt(float_sse a) { return _mm_sqrt_ps(a.v); }
+inline float_sse simd_min(float_sse a, float_sse b) { return _mm_min_ps(a.v, b.v); }
+inline float_sse simd_max(float_sse a, float_sse b) { return _mm_max_ps(a.v, b.v); }
+// a where mask is set, b elsewhere
+inline float_sse simd_select(mask_sse m, float_sse a, float_sse b) { return _mm_or_ps(_mm_and_ps(m.m, a.v), _mm_andnot_ps(m.m, b.v)); }
+inline bool simd_any(mask_sse m) { return _mm_movemask_ps(m.m) != 0; }
+inline bool simd_all(mask_sse m) { return _mm_movemask_ps(m.m) == 0xF; }
+#endif
+
+#ifdef CURL_NOISE_SIMD_AVX2
+struct mask_avx2
+{
+	__m256 m;
+};
+
+struct float_avx2
+{
+	static const int width = 8;
+	typedef mask_avx2 mask;
+	__m256 v;
+
+	float_avx2() : v(_mm256_setzero_ps()) {}
+	float_avx2(float f) : v(_mm256_set1_ps(f)) {}
+	float_avx2(__m256 m) : v(m) {}
+
+	static float_avx2 load(const float* p) { return _mm256_loadu_ps(p); }
+	void store(float* p) const { _mm256_storeu_ps(p, v); }
+};
+
+inline float_avx2 operator+(float_avx2 a, float_avx2 b) { return _mm256_add_ps(a.v, b.v); }
+inline float_avx2 operator-(float_avx2 a, float_avx2 b) { return _mm256_sub_ps(a.v, b.v); }
+inline float_avx2 operator*(float_avx2 a, float_avx2 b) { return _mm256_mul_ps(a.v, b.v); }
+inline float_avx2 operator/(float_avx2 a, float_avx2 b) { return _mm256_div_ps(a.v, b.v); }
+inline float_avx2 operator-(float_avx2 a) { return _mm256_xor_ps(a.v, _mm256_set1_ps(-0.0f)); }
+inline mask_avx2 operator<(float_avx2 a, float_avx2 b) { return { _mm256_cmp_ps(a.v, b.v, _CMP_LT_OQ) }; }
+inline mask_avx2 operator>(float_avx2 a, float_avx2 b) { return { _mm256_cmp_ps(a.v, b.v, _CMP_GT_OQ) }; }
+inline mask_avx2 operator&(mask_avx2 a, mask_avx2 b) { return { _mm256_and_ps(a.m, b.m) }; }
+inline mask_avx2 operator|(mask_avx2 a, mask_avx2 b) { return { _mm256_or_ps(a.m, b.m) }; }
+inline float_avx2 simd_sqrt(float_avx2 a) { return _mm256_sqrt_ps(a.v); }
+inline float_avx2 simd_min(float_avx2 a, float_avx2 b) { return _mm256_min_ps(a.v, b.v); }
+inline float_avx2 simd_max(float_avx2 a, float_avx2 b) { return _mm256_max_ps(a.v, b.v); }
+// a where mask is set, b elsewhere
+inline float_avx2 simd_select(mask_avx2 m, float_avx2 a, float_avx2 b) { return _mm256_blendv_ps(b.v, a.v, m.m); }
+inline bool simd_any(mask_avx2 m) { return _mm256_movemask_ps(m.m) != 0; }
+inline bool simd_all(mask_avx2 m) { return _mm256_movemask_ps(m.m) == 0xFF; }
+#endif
+
+#ifdef CURL_NOISE_SIMD_AVX512
+struct mask_avx512
+{
+	__mmask16 m;
+};
+
+struct float_avx512
+{
+	static const int width = 16;
+	typedef mask_avx512 mask;
+	__m512 v;
+
+	float_avx512() : v(_mm512_setzero_ps()) {}
+	float_avx512(float f) : v(_mm512_set1_ps(f)) {}
+	float_avx512(__m512 m) : v(m) {}
+
+	static float_avx512 load(const float* p) { return _mm512_loadu_ps(p); }
+	void store(float* p) const { _mm512_storeu_ps(p, v); }
+};
+
+inline float_avx512 operator+(float_avx512 a, float_avx512 b) { return _mm512_add_ps(a.v, b.v); }
+inline float_avx512 operator-(float_avx512 a, float_avx512 b) { return _mm512_sub_ps(a.v, b.v); }
+inline float_avx512 operator*(float_avx512 a, float_avx512 b) { return _mm512_mul_ps(a.v, b.v); }
+inline float_avx512 operator/(float_avx512 a, float_avx512 b) { return _mm512_div_ps(a.v, b.v); }
+inline float_avx512 operator-(float_avx512 a) { return _mm512_sub_ps(_mm512_setzero_ps(), a.v); }
+inline mask_avx512 operator<(float_avx512 a, float_avx512 b) { return { _mm512_cmp_ps_mask(a.v, b.v, _CMP_LT_OQ) }; }
+inline mask_avx512 operator>(float_avx512 a, float_avx512 b) { return { _mm512_cmp_ps_mask(a.v, b.v, _CMP_GT_OQ) }; }
+inline mask_avx512 operator&(mask_avx512 a, mask_avx512 b) { return { static_cast<__mmask16>(a.m & b.m) }; }
+inline mask_avx512 operator|(mask_avx512 a, mask_avx512 b) { return { static_cast<__mmask16>(a.m | b.m) }; }
+inline float_avx512 simd_sqrt(float_avx512 a) { return _mm512_sqrt_ps(a.v); }
+inline float_avx512 simd_min(float_avx512 a, float_avx512 b) { return _mm512_min_ps(a.v, b.v); }
+inline float_avx512 simd_max(float_avx512 a, float_avx512 b) { return _mm512_max_ps(a.v, b.v); }
+// a where mask is set, b elsewhere
+inline float_avx512 simd_select(mask_avx512 m, float_avx512 a, float_avx512 b) { return _mm512_mask_blend_ps(m.m, b.v, a.v); }
+inline bool simd_any(mask_avx512 m) { return m.m != 0; }
+inline bool simd_all(mask_avx512 m) { return m.m == 0xFFFF; }
+#endif
@@ -0,0 +1,481 @@
+#pragma once
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "defines.h"
+#include "field_scene.h"
+#include "velocity_grid.h"
+#include "thread_pool.h"
+#include "tracer.h"
+#include "tracer_lod.h"
+#include "trajectory.h"
+#include "triple_buffer.h"
+
+// everything the render loop can change about the simulation
+struct SimulationSettings
+{
+	float radius = 5.95f;
+	float step_size = 0.005f;
+	IntegratorSettings integrator;
+	bool use_grid = false;
+	bool tricubic = false;
+	bool running = false;
+	// every step only advances the head of each trail, so steps can run far more often than the old 0.1s
+	float step_interval = 0.01f;
+	TracerLodSettings lod;
+	TracerLodView view;
+};
+
+// unrolled trails of one simulation step, ready for upload
+struct TracerSnapshot
+{
+	std::vector<TracerVertex> vertices;
+	// the layout of vertices, copied here so the render thread never reads the simulation's trails
+	size_t tracer_count = 0;
+	int trail_length = 0;
+	uint64 step = 0;
+};
+
+// advects the tracers on its own thread at its own tick rate and publishes snapshots through a triple buffer,
+// a slow step never holds up a frame
+class Simulation
+{
+public:
+	Simulation(const FieldScene& field_scene, int i_trace_count, int j_trace_count, int k_trace_count, int l_trace_count, float tracing_width, float tracing_height)
+		: field_scene(field_scene),
+		// baked velocity field at 17 radius keyframes, about 85 MB, the slider blends between them
+		// the ring cores change size with the radius, so closer keyframes beat a finer lattice
+		velocity_grid_keyframes(field_scene, glm::vec3(-12.0f, -12.0f, -12.0f), glm::vec3(12.0f, 6.0f, 12.0f), 65, 49, 65, radius_keyframes(5.95f, 8)),
+		// the render thread keeps one core
+		thread_pool(std::max(2u, std::thread::hardware_concurrency()) - 1),
+		i_trace_count(i_trace_count), j_trace_count(j_trace_count), k_trace_count(k_trace_count), l_trace_count(l_trace_count),
+		tracing_width(tracing_width), tracing_height(tracing_height)
+	{
+		compile_scene(field_scene, settings.radius, &scene);
+		reset_tracers();
+		TracerSnapshot snapshot;
+		snapshot.vertices.resize(trails.tracer_count * trails.length);
+		snapshot.tracer_count = trails.tracer_count;
+		snapshot.trail_length = trails.length;
+		unroll_trails(0, trails.tracer_count, trails, &snapshot.vertices);
+		snapshots.fill(snapshot);
+		thread = std::thread(&Simulation::run, this);
+	}
+
+	virtual ~Simulation()
+	{
+		{
+			std::lock_guard<std::mutex> lock(mutex);
+			stop = true;
+		}
+		wake.notify_all();
+		thread.join();
+	}
+
+	void setSettings(const SimulationSettings& settings)
+	{
+		std::lock_guard<std::mutex> lock(mutex);
+		this->settings = settings;
+	}
+
+	// one step forward, also while paused
+	void step()
+	{
+		command([this]() { pending_step = true; });
+	}
+
+	// tracers back to their start
+	void reset()
+	{
+		command([this]() { pending_reset = true; });
+	}
+
+	// divides every z by the tracing width, maps the tracers to 2D
+	void flatten()
+	{
+		command([this]() { pending_flatten = true; });
+	}
+
+	// streams the positions after every live step to path, starting with the current ones
+	void record(const std::string& path)
+	{
+		command([this, path]() { pending_record = path; pending_stop_record = false; });
+	}
+
+	void stop_recording()
+	{
+		command([this]() { pending_stop_record = true; pending_record.clear(); });
+	}
+
+	// shows the recording at path instead of simulating, steps and the running flag advance its frames
+	void replay(const std::string& path)
+	{
+		command([this, path]() { pending_replay = path; pending_stop_replay = false; });
+	}
+
+	// back to the simulation, the tracers start over
+	void stop_replay()
+	{
+		command([this]() { pending_stop_replay = true; pending_replay.clear(); });
+	}
+
+	void seek_replay(uint64 frame)
+	{
+		command([this, frame]() { pending_seek = static_cast<int64>(frame); });
+	}
+
+	// render thread, switches to the newest snapshot, false if there was none since the last call
+	bool update_snapshot()
+	{
+		return snapshots.update();
+	}
+
+	const TracerSnapshot& getSnapshot() const
+	{
+		return snapshots.read_buffer();
+	}
+
+	bool isBaking() const
+	{
+		return baking;
+	}
+
+	int getBaked_keyframes() const
+	{
+		return velocity_grid_keyframes.getBuilt_count();
+	}
+
+	int getKeyframe_count() const
+	{
+		return velocity_grid_keyframes.getKeyframe_count();
+	}
+
+	float getStep_ms() const
+	{
+		return step_ms;
+	}
+
+	// tracers the last step advanced, all of them without level of detail
+	size_t getUpdated_count() const
+	{
+		return updated_count;
+	}
+
+	int getLod_bias() const
+	{
+		return lod_bias;
+	}
+
+	bool isRecording() const
+	{
+		return recording;
+	}
+
+	uint64 getRecorded_frames() const
+	{
+		return recorded_frames;
+	}
+
+	bool isReplaying() const
+	{
+		return replaying;
+	}
+
+	int64 getReplay_frame() const
+	{
+		return replay_frame;
+	}
+
+	uint64 getReplay_frame_count() const
+	{
+		return replay_frame_count;
+	}
+
+private:
+	template <typename F>
+	void command(F set)
+	{
+		{
+			std::lock_guard<std::mutex> lock(mutex);
+			set();
+		}
+		wake.notify_all();
+	}
+
+	void reset_tracers()
+	{
+		init_tracers(&particles, &trails, i_trace_count, j_trace_count, k_trace_count, l_trace_count, tracing_width, tracing_height);
+		enable_adaptive_step(&particles, settings.step_size);
+		tracer_lod.init(trails.tracer_count);
+	}
+
+	void start_recording(const std::string& path, float step_size)
+	{
+		float min[3], max[3];
+		// a margin of the tracing width, enough for the downwash of the default radius
+		trajectory_bounds(tracing_width, tracing_height, tracing_width, min, max);
+		if (!trajectory_writer.open(path.c_str(), particles.count, min, max, step_size)) return;
+		trajectory_writer.push(particles);
+		recording = true;
+		recorded_frames = trajectory_writer.getFrame_count();
+	}
+
+	void start_replay(const std::string& path)
+	{
+		if (!trajectory_reader.open(path.c_str()) || trajectory_reader.getFrame_count() == 0) return;
+		// the render thread sized its buffers for the tracers of this simulation
+		if (trajectory_reader.getTracer_count() != trails.tracer_count)
+		{
+			std::cout << path << " holds " << trajectory_reader.getTracer_count() << " tracers, the simulation " << trails.tracer_count << std::endl;
+			return;
+		}
+		// a recording never replays itself while it is written
+		trajectory_writer.close();
+		recording = false;
+		init_particles(&particles, trajectory_reader.getTracer_count());
+		replaying = true;
+		replay_frame = -1;
+		replay_frame_count = trajectory_reader.getFrame_count();
+		show_replay_frame(0);
+	}
+
+	// decodes frame and rebuilds the trails, from the previous frame or from l_trace_count frames before it
+	void show_replay_frame(uint64 frame)
+	{
+		uint64 first = frame;
+		if (replay_frame < 0 || frame != static_cast<uint64>(replay_frame) + 1)
+		{
+			first = frame > static_cast<uint64>(l_trace_count) ? frame - l_trace_count : 0;
+			if (!trajectory_reader.seek(first))
+			{
+				replaying = false;
+				return;
+			}
+			trajectory_reader.getPositions(&particles);
+			init_replay_trails(particles, &trails, l_trace_count);
+			first++;
+		}
+		for (uint64 f = first; f <= frame; f++)
+		{
+			if (!trajectory_reader.seek(f))
+			{
+				replaying = false;
+				return;
+			}
+			trajectory_reader.getPositions(&particles);
+			thread_pool.parallel_for(trails.tracer_count, 1024, [&](size_t begin, size_t end)
+			{
+				record_replay_trails(begin, end, particles, &trails);
+			});
+		}
+		replay_frame = static_cast<int64>(frame);
+	}
+
+	void run()
+	{
+		PROFILE_THREAD_NAME("simulation");
+		auto next_tick = std::chrono::steady_clock::now();
+		while (true)
+		{
+			SimulationSettings s;
+			bool do_step, do_reset, do_flatten, do_stop_record, do_stop_replay;
+			std::string record_path, replay_path;
+			int64 seek;
+			{
+				std::unique_lock<std::mutex> lock(mutex);
+				wake.wait_until(lock, next_tick, [this]() { return stop || pending_step || pending_reset || pending_flatten || pending_stop_record || pending_stop_replay || !pending_record.empty() || !pending_replay.empty() || pending_seek >= 0; });
+				if (stop) return;
+				s = settings;
+				do_step = pending_step;
+				do_reset = pending_reset;
+				do_flatten = pending_flatten;
+				do_stop_record = pending_stop_record;
+				do_stop_replay = pending_stop_replay;
+				record_path.swap(pending_record);
+				replay_path.swap(pending_replay);
+				seek = pending_seek;
+				pending_step = pending_reset = pending_flatten = pending_stop_record = pending_stop_replay = false;
+				pending_record.clear();
+				pending_replay.clear();
+				pending_seek = -1;
+			}
+			bool changed = false;
+			if (do_stop_record)
+			{
+				trajectory_writer.close();
+				recording = false;
+			}
+			if (do_stop_replay && replaying)
+			{
+				replaying = false;
+				do_reset = true;
+			}
+			if (!replay_path.empty())
+			{
+				start_replay(replay_path);
+				changed = true;
+			}
+			if (do_reset && replaying)
+			{
+				show_replay_frame(0);
+				changed = true;
+			}
+			else if (do_reset)
+			{
+				reset_tracers();
+				changed = true;
+			}
+			if (seek >= 0 && replaying)
+			{
+				show_replay_frame(std::min(static_cast<uint64>(seek), replay_frame_count - 1));
+				changed = true;
+			}
+			if (!record_path.empty() && !replaying) start_recording(record_path, s.step_size);
+			if (do_flatten)
+			{
+				for (float& z : particles.z)
+				{
+					z /= (tracing_width);
+				}
+				for (glm::vec3& point : trails.points)
+				{
+					point.z /= (tracing_width);
+				}
+				changed = true;
+			}
+
+			if (s.use_grid) velocity_grid_keyframes.request(s.radius);
+			baking = s.use_grid && velocity_grid_keyframes.isBuilding();
+
+			auto now = std::chrono::steady_clock::now();
+			auto interval = std::chrono::duration_cast<std::chrono::steady_clock::duration>(std::chrono::duration<float>(s.step_interval));
+			bool tick = s.running && now >= next_tick;
+			if (replaying && (tick || do_step))
+			{
+				// holds the last frame until the replay is stopped or seeks back
+				if (static_cast<uint64>(replay_frame) + 1 < replay_frame_count)
+				{
+					show_replay_frame(replay_frame + 1);
+					changed = true;
+				}
+			}
+			else if (tick || do_step)
+			{
+				PROFILE_SCOPE("step");
+				// the analytic field until both keyframes around the radius are baked
+				VelocityGridBlend grid = s.use_grid ? velocity_grid_keyframes.get(s.radius) : VelocityGridBlend();
+				GridInterpolation interpolation = s.tricubic ? GridInterpolation::Tricubic : GridInterpolation::Trilinear;
+				if (scene.radius != s.radius) compile_scene(field_scene, s.radius, &scene);
+				if (s.lod.enabled)
+				{
+					if (!lod_enabled) tracer_lod.init(trails.tracer_count);
+					thread_pool.parallel_for(trails.tracer_count, 1024, [&](size_t begin, size_t end)
+					{
+						tracer_lod.classify(begin, end, particles, s.view, s.lod);
+					});
+					tracer_lod.schedule(steps, s.step_size, s.lod);
+					const std::vector<uint32>& due = tracer_lod.getDue();
+					const std::vector<float>& dt = tracer_lod.getDt();
+					auto advect_start = std::chrono::steady_clock::now();
+					thread_pool.parallel_for(due.size(), tracer_chunk_size, [&](size_t begin, size_t end)
+					{
+						calculate_new_positions(&due[begin], &dt[begin], end - begin, &particles, scene, grid, interpolation, s.integrator);
+						record_trails(&due[begin], end - begin, particles, &trails);
+					}, "advect");
+					tracer_lod.report(std::chrono::duration<float, std::milli>(std::chrono::steady_clock::now() - advect_start).count(), due.size());
+					updated_count = due.size();
+					lod_bias = tracer_lod.getBias();
+				}
+				else
+				{
+					thread_pool.parallel_for(trails.tracer_count, tracer_chunk_size, [&](size_t begin, size_t end)
+					{
+						calculate_new_positions(begin, end, &particles, scene, s.step_size, grid, interpolation, s.integrator);
+						record_trails(begin, end, particles, &trails);
+					}, "advect");
+					updated_count = trails.tracer_count;
+					lod_bias = 0;
+				}
+				lod_enabled = s.lod.enabled;
+				steps++;
+				if (recording)
+				{
+					trajectory_writer.push(particles);
+					recorded_frames = trajectory_writer.getFrame_count();
+				}
+				step_ms = std::chrono::duration<float, std::milli>(std::chrono::steady_clock::now() - now).count();
+				changed = true;
+			}
+			// fixed rate while it keeps up, a step that took too long pushes the next one back instead of piling up
+			next_tick = (tick && next_tick + interval > now) ? next_tick + interval : now + interval;
+
+			if (changed)
+			{
+				// line vertices are only generated for the snapshot
+				PROFILE_SCOPE("unroll");
+				TracerSnapshot& snapshot = snapshots.write_buffer();
+				thread_pool.parallel_for(trails.tracer_count, 256, [&](size_t begin, size_t end)
+				{
+					unroll_trails(begin, end, trails, &snapshot.vertices);
+				});
+				snapshot.tracer_count = trails.tracer_count;
+				snapshot.trail_length = trails.length;
+				snapshot.step = replaying ? static_cast<uint64>(replay_frame) : steps;
+				snapshots.publish();
+			}
+		}
+	}
+
+	// tracers near the vortex ring are more expensive, small chunks let idle workers steal them
+	const size_t tracer_chunk_size = 16;
+
+	FieldScene field_scene;
+	CompiledScene scene;
+	VelocityGridKeyframes velocity_grid_keyframes;
+	ThreadPool thread_pool;
+	ParticleStore particles;
+	Trails trails;
+	TracerLod tracer_lod;
+	bool lod_enabled = false;
+	TrajectoryWriter trajectory_writer;
+	TrajectoryReader trajectory_reader;
+	int i_trace_count;
+	int j_trace_count;
+	int k_trace_count;
+	int l_trace_count;
+	float tracing_width;
+	float tracing_height;
+	uint64 steps = 0;
+
+	TripleBuffer<TracerSnapshot> snapshots;
+	std::atomic<bool> baking{ false };
+	std::atomic<float> step_ms{ 0.0f };
+	std::atomic<size_t> updated_count{ 0 };
+	std::atomic<int> lod_bias{ 0 };
+	std::atomic<bool> recording{ false };
+	std::atomic<uint64> recorded_frames{ 0 };
+	std::atomic<bool> replaying{ false };
+	std::atomic<int64> replay_frame{ -1 };
+	std::atomic<uint64> replay_frame_count{ 0 };
+
+	// guarded by mutex
+	SimulationSettings settings;
+	bool pending_step = false;
+	bool pending_reset = false;
+	bool pending_flatten = false;
+	std::string pending_record;
+	bool pending_stop_record = false;
+	std::string pending_replay;
+	bool pending_stop_replay = false;
+	int64 pending_seek = -1;
+	bool stop = false;
+	std::mutex mutex;
+	std::condition_variable wake;
+	std::thread thread;
+};
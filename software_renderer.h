@@ -0,0 +1,486 @@
+#pragma once
+#include <algorithm>
+#include <cmath>
+#include <condition_variable>
+#include <cstdio>
+#include <deque>
+#include <iostream>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "glm.hpp"
+#include "stb_image_write.h"
+#include "bmf.h"
+#include "defines.h"
+#include "thread_pool.h"
+
+// cpu rasterizer for frames without a gpu, draws what the window draws: tracer lines colored like tracer.vert
+// and model triangles in their diffuse color, both depth tested
+// draw_lines and draw_mesh transform, clip against the near plane and bin the primitives into tiles in parallel,
+// flush rasterizes the tiles in parallel, every tile is owned by one thread so nothing is shared while drawing
+// primitives are drawn in the order they were added, so a frame comes out the same for any thread count
+// rows are stored from the top, as png expects them
+
+// rgba8 in memory order
+inline uint32 pack_color(const glm::vec4& color)
+{
+	auto channel = [](float c) { return static_cast<uint32>(std::min(std::max(c, 0.0f), 1.0f) * 255.0f + 0.5f); };
+	return channel(color.r) | (channel(color.g) << 8) | (channel(color.b) << 16) | (channel(color.a) << 24);
+}
+
+class SoftwareRenderer
+{
+public:
+	// pool is shared with whoever else uses it between the draw calls
+	SoftwareRenderer(int width, int height, ThreadPool* pool)
+		: width(width), height(height), pool(pool)
+	{
+		tiles_x = (width + TILE_SIZE - 1) / TILE_SIZE;
+		tiles_y = (height + TILE_SIZE - 1) / TILE_SIZE;
+		color.resize(static_cast<size_t>(width) * height);
+		depth.resize(static_cast<size_t>(width) * height);
+		bin_sets = 4 * pool->getThread_count();
+		line_bins.resize(bin_sets * tiles_x * tiles_y);
+		triangle_bins.resize(bin_sets * tiles_x * tiles_y);
+	}
+
+	// also drops everything drawn since the last flush
+	void clear(const glm::vec4& clear_color)
+	{
+		this->clear_color = pack_color(clear_color);
+		lines.clear();
+		triangles.clear();
+	}
+
+	// length points per tracer from the oldest to the head, as unroll_trails writes them
+	void draw_lines(const std::vector<TracerVertex>& vertices, size_t tracer_count, int length, const glm::mat4& view_projection, float line_width)
+	{
+		if (length < 2) return;
+		const size_t segments = static_cast<size_t>(length - 1);
+		size_t first = lines.size();
+		lines.resize(first + tracer_count * segments);
+		const float radius = 0.5f * line_width;
+		pool->parallel_for(tracer_count, 256, [&](size_t begin, size_t end)
+		{
+			for (size_t t = begin; t < end; t++)
+			{
+				const TracerVertex* strip = &vertices[t * length];
+				glm::vec4 a = view_projection * glm::vec4(strip[0].position, 1.0f);
+				for (size_t s = 0; s < segments; s++)
+				{
+					glm::vec4 b = view_projection * glm::vec4(strip[s + 1].position, 1.0f);
+					setup_line(a, b, strip[s].parameter, strip[s + 1].parameter, radius, &lines[first + t * segments + s]);
+					a = b;
+				}
+			}
+		});
+	}
+
+	// a model mesh in its diffuse color, like the window does without lighting
+	void draw_mesh(const BmfMesh& mesh, const glm::mat4& view_projection)
+	{
+		const size_t count = mesh.indices.size / 3;
+		size_t first = triangles.size();
+		// a triangle through the near plane can become two
+		triangles.resize(first + 2 * count);
+		uint32 mesh_color = pack_color(glm::vec4(mesh.material->diffuse, 1.0f));
+		pool->parallel_for(count, 1024, [&](size_t begin, size_t end)
+		{
+			for (size_t i = begin; i < end; i++)
+			{
+				glm::vec4 clip[3];
+				for (int k = 0; k < 3; k++)
+				{
+					uint32 index = mesh.indices.data[i * 3 + k];
+					clip[k] = index < mesh.vertices.size ? view_projection * glm::vec4(mesh.vertices.data[index].position, 1.0f) : glm::vec4(0.0f, 0.0f, 0.0f, 0.0f);
+				}
+				setup_triangle(clip, mesh_color, &triangles[first + 2 * i], &triangles[first + 2 * i + 1]);
+			}
+		});
+	}
+
+	// bins and rasterizes everything drawn since clear
+	void flush()
+	{
+		const size_t tile_count = static_cast<size_t>(tiles_x) * tiles_y;
+		// every set bins a contiguous range of primitives, the tiles walk the sets in order
+		pool->parallel_for(bin_sets, 1, [&](size_t begin, size_t end)
+		{
+			for (size_t set = begin; set < end; set++)
+			{
+				std::vector<uint32>* line_set = &line_bins[set * tile_count];
+				std::vector<uint32>* triangle_set = &triangle_bins[set * tile_count];
+				for (size_t tile = 0; tile < tile_count; tile++)
+				{
+					line_set[tile].clear();
+					triangle_set[tile].clear();
+				}
+				bin(lines, set, line_set);
+				bin(triangles, set, triangle_set);
+			}
+		});
+		pool->parallel_for(tile_count, 1, [&](size_t begin, size_t end)
+		{
+			for (size_t tile = begin; tile < end; tile++) rasterize_tile(tile);
+		});
+	}
+
+	const std::vector<uint32>& getColor() const
+	{
+		return color;
+	}
+
+	int getWidth() const
+	{
+		return width;
+	}
+
+	int getHeight() const
+	{
+		return height;
+	}
+
+private:
+	static const int TILE_SIZE = 64;
+
+	// screen space, x and y in pixels from the top left, z the depth from 0 at the near to 1 at the far plane
+	struct RasterLine
+	{
+		glm::vec3 a;
+		glm::vec3 b;
+		float parameter_a;
+		float parameter_b;
+		float radius;  // half the width of the draw_lines call, calls between clear and flush may differ
+		bool visible;
+		int min_x, min_y, max_x, max_y; // pixel bounds
+	};
+
+	struct RasterTriangle
+	{
+		glm::vec3 v[3];
+		uint32 color;
+		bool visible;
+		int min_x, min_y, max_x, max_y;
+	};
+
+	glm::vec3 to_screen(const glm::vec4& clip) const
+	{
+		float inv_w = 1.0f / clip.w;
+		return glm::vec3((clip.x * inv_w * 0.5f + 0.5f) * width, (0.5f - clip.y * inv_w * 0.5f) * height, clip.z * inv_w * 0.5f + 0.5f);
+	}
+
+	// bounds clamped to the screen, false if nothing of them is on it
+	// primitives are only clipped against the near plane, so a vertex just past it can land far outside of the int
+	// range, the bounds get clamped to [-1, width] and [-1, height] in float before the conversion
+	bool screen_bounds(float min_x, float min_y, float max_x, float max_y, int* bounds) const
+	{
+		// written so NaN counts as off screen
+		if (!(max_x >= 0.0f && max_y >= 0.0f && min_x <= width && min_y <= height)) return false;
+		min_x = std::max(min_x, -1.0f);
+		min_y = std::max(min_y, -1.0f);
+		max_x = std::min(max_x, static_cast<float>(width));
+		max_y = std::min(max_y, static_cast<float>(height));
+		bounds[0] = std::max(0, static_cast<int>(std::floor(min_x)));
+		bounds[1] = std::max(0, static_cast<int>(std::floor(min_y)));
+		bounds[2] = std::min(width - 1, static_cast<int>(std::ceil(max_x)));
+		bounds[3] = std::min(height - 1, static_cast<int>(std::ceil(max_y)));
+		return bounds[0] <= bounds[2] && bounds[1] <= bounds[3];
+	}
+
+	void setup_line(glm::vec4 a, glm::vec4 b, float parameter_a, float parameter_b, float radius, RasterLine* line) const
+	{
+		line->visible = false;
+		// the near plane of the clip volume is z = -w
+		float da = a.z + a.w;
+		float db = b.z + b.w;
+		if (da < 0.0f && db < 0.0f) return;
+		if (da < 0.0f || db < 0.0f)
+		{
+			float t = da / (da - db);
+			glm::vec4 c = a + (b - a) * t;
+			float parameter_c = parameter_a + (parameter_b - parameter_a) * t;
+			if (da < 0.0f)
+			{
+				a = c;
+				parameter_a = parameter_c;
+			}
+			else
+			{
+				b = c;
+				parameter_b = parameter_c;
+			}
+		}
+		line->a = to_screen(a);
+		line->b = to_screen(b);
+		line->parameter_a = parameter_a;
+		line->parameter_b = parameter_b;
+		line->radius = radius;
+		int bounds[4];
+		if (!screen_bounds(std::min(line->a.x, line->b.x) - radius, std::min(line->a.y, line->b.y) - radius,
+			std::max(line->a.x, line->b.x) + radius, std::max(line->a.y, line->b.y) + radius, bounds)) return;
+		line->min_x = bounds[0];
+		line->min_y = bounds[1];
+		line->max_x = bounds[2];
+		line->max_y = bounds[3];
+		line->visible = true;
+	}
+
+	void setup_triangle(const glm::vec4 clip[3], uint32 triangle_color, RasterTriangle* first, RasterTriangle* second) const
+	{
+		first->visible = false;
+		second->visible = false;
+		// clipped against the near plane, three or four corners are left when any is
+		glm::vec4 polygon[4];
+		int corners = 0;
+		for (int k = 0; k < 3; k++)
+		{
+			const glm::vec4& a = clip[k];
+			const glm::vec4& b = clip[(k + 1) % 3];
+			float da = a.z + a.w;
+			float db = b.z + b.w;
+			if (da >= 0.0f) polygon[corners++] = a;
+			if ((da >= 0.0f) != (db >= 0.0f) && corners < 4) polygon[corners++] = a + (b - a) * (da / (da - db));
+		}
+		if (corners < 3) return;
+		glm::vec3 screen[4];
+		for (int k = 0; k < corners; k++) screen[k] = to_screen(polygon[k]);
+		set_triangle(screen[0], screen[1], screen[2], triangle_color, first);
+		if (corners == 4) set_triangle(screen[0], screen[2], screen[3], triangle_color, second);
+	}
+
+	void set_triangle(const glm::vec3& a, const glm::vec3& b, const glm::vec3& c, uint32 triangle_color, RasterTriangle* triangle) const
+	{
+		int bounds[4];
+		if (!screen_bounds(std::min(a.x, std::min(b.x, c.x)), std::min(a.y, std::min(b.y, c.y)),
+			std::max(a.x, std::max(b.x, c.x)), std::max(a.y, std::max(b.y, c.y)), bounds)) return;
+		triangle->v[0] = a;
+		triangle->v[1] = b;
+		triangle->v[2] = c;
+		triangle->color = triangle_color;
+		triangle->min_x = bounds[0];
+		triangle->min_y = bounds[1];
+		triangle->max_x = bounds[2];
+		triangle->max_y = bounds[3];
+		triangle->visible = true;
+	}
+
+	template <typename Primitive>
+	void bin(const std::vector<Primitive>& primitives, size_t set, std::vector<uint32>* bins) const
+	{
+		size_t begin = primitives.size() * set / bin_sets;
+		size_t end = primitives.size() * (set + 1) / bin_sets;
+		for (size_t p = begin; p < end; p++)
+		{
+			const Primitive& primitive = primitives[p];
+			if (!primitive.visible) continue;
+			for (int ty = primitive.min_y / TILE_SIZE; ty <= primitive.max_y / TILE_SIZE; ty++)
+			{
+				for (int tx = primitive.min_x / TILE_SIZE; tx <= primitive.max_x / TILE_SIZE; tx++)
+				{
+					bins[ty * tiles_x + tx].push_back(static_cast<uint32>(p));
+				}
+			}
+		}
+	}
+
+	void rasterize_tile(size_t tile)
+	{
+		const int x0 = static_cast<int>(tile % tiles_x) * TILE_SIZE;
+		const int y0 = static_cast<int>(tile / tiles_x) * TILE_SIZE;
+		const int x1 = std::min(width, x0 + TILE_SIZE) - 1;
+		const int y1 = std::min(height, y0 + TILE_SIZE) - 1;
+		for (int y = y0; y <= y1; y++)
+		{
+			std::fill(&color[static_cast<size_t>(y) * width + x0], &color[static_cast<size_t>(y) * width + x1] + 1, clear_color);
+			std::fill(&depth[static_cast<size_t>(y) * width + x0], &depth[static_cast<size_t>(y) * width + x1] + 1, 1.0f);
+		}
+		const size_t tile_count = static_cast<size_t>(tiles_x) * tiles_y;
+		for (size_t set = 0; set < bin_sets; set++)
+		{
+			for (uint32 t : triangle_bins[set * tile_count + tile]) rasterize_triangle(triangles[t], x0, y0, x1, y1);
+		}
+		for (size_t set = 0; set < bin_sets; set++)
+		{
+			for (uint32 l : line_bins[set * tile_count + tile]) rasterize_line(lines[l], x0, y0, x1, y1);
+		}
+	}
+
+	void rasterize_triangle(const RasterTriangle& triangle, int x0, int y0, int x1, int y1)
+	{
+		const glm::vec3& a = triangle.v[0];
+		const glm::vec3& b = triangle.v[1];
+		const glm::vec3& c = triangle.v[2];
+		float area = (b.x - a.x) * (c.y - a.y) - (b.y - a.y) * (c.x - a.x);
+		if (area == 0.0f) return;
+		// either winding, the window does not cull either
+		float inv_area = 1.0f / area;
+		for (int y = std::max(y0, triangle.min_y); y <= std::min(y1, triangle.max_y); y++)
+		{
+			float py = y + 0.5f;
+			for (int x = std::max(x0, triangle.min_x); x <= std::min(x1, triangle.max_x); x++)
+			{
+				float px = x + 0.5f;
+				float w0 = ((b.x - px) * (c.y - py) - (b.y - py) * (c.x - px)) * inv_area;
+				float w1 = ((c.x - px) * (a.y - py) - (c.y - py) * (a.x - px)) * inv_area;
+				float w2 = 1.0f - w0 - w1;
+				if (w0 < 0.0f || w1 < 0.0f || w2 < 0.0f) continue;
+				// depth is linear in screen space after the perspective divide
+				float z = w0 * a.z + w1 * b.z + w2 * c.z;
+				size_t pixel = static_cast<size_t>(y) * width + x;
+				if (z < 0.0f || z >= depth[pixel]) continue;
+				depth[pixel] = z;
+				color[pixel] = triangle.color;
+			}
+		}
+	}
+
+	// pixels within line.radius of the segment, round caps close the gaps between the segments of a trail
+	void rasterize_line(const RasterLine& line, int x0, int y0, int x1, int y1)
+	{
+		const float dx = line.b.x - line.a.x;
+		const float dy = line.b.y - line.a.y;
+		const float length2 = dx * dx + dy * dy;
+		const float inv_length2 = length2 > 0.0f ? 1.0f / length2 : 0.0f;
+		const float radius2 = line.radius * line.radius;
+		for (int y = std::max(y0, line.min_y); y <= std::min(y1, line.max_y); y++)
+		{
+			float py = y + 0.5f - line.a.y;
+			for (int x = std::max(x0, line.min_x); x <= std::min(x1, line.max_x); x++)
+			{
+				float px = x + 0.5f - line.a.x;
+				float t = std::min(std::max((px * dx + py * dy) * inv_length2, 0.0f), 1.0f);
+				float ex = px - t * dx;
+				float ey = py - t * dy;
+				if (ex * ex + ey * ey > radius2) continue;
+				float z = line.a.z + (line.b.z - line.a.z) * t;
+				size_t pixel = static_cast<size_t>(y) * width + x;
+				if (z < 0.0f || z >= depth[pixel]) continue;
+				depth[pixel] = z;
+				// blue at the oldest point of a trail, red at its head
+				float parameter = line.parameter_a + (line.parameter_b - line.parameter_a) * t;
+				color[pixel] = pack_color(glm::vec4(parameter, 0.0f, 1.0f - parameter, 1.0f));
+			}
+		}
+	}
+
+	int width;
+	int height;
+	int tiles_x;
+	int tiles_y;
+	ThreadPool* pool;
+	size_t bin_sets;
+	uint32 clear_color = 0xFFFFFFFF;
+	std::vector<uint32> color;
+	std::vector<float> depth;
+	std::vector<RasterLine> lines;
+	std::vector<RasterTriangle> triangles;
+	std::vector<std::vector<uint32>> line_bins;     // bin_sets * tiles, primitive indices per set and tile
+	std::vector<std::vector<uint32>> triangle_bins;
+};
+
+// writes frames as numbered pngs on encoder threads of its own, deflate takes longer than drawing a frame
+class PngSequenceWriter
+{
+public:
+	// pattern is a printf format for the frame number, e.g. frames/frame_%05d.png
+	PngSequenceWriter(const std::string& pattern, int width, int height, unsigned int thread_count)
+		: pattern(pattern), width(width), height(height)
+	{
+		for (unsigned int i = 0; i < std::max(1u, thread_count); i++) encoders.push_back(std::thread(&PngSequenceWriter::run, this));
+	}
+
+	PngSequenceWriter(const PngSequenceWriter&) = delete;
+	PngSequenceWriter& operator=(const PngSequenceWriter&) = delete;
+
+	virtual ~PngSequenceWriter()
+	{
+		finish();
+	}
+
+	// copies the image and queues it, waits while every encoder already has two frames waiting
+	void push(int frame, const std::vector<uint32>& image)
+	{
+		Frame queued;
+		{
+			std::unique_lock<std::mutex> lock(mutex);
+			taken.wait(lock, [this]() { return queue.size() < 2 * encoders.size(); });
+			if (!spare.empty())
+			{
+				queued.pixels.swap(spare.back());
+				spare.pop_back();
+			}
+		}
+		queued.number = frame;
+		queued.pixels.assign(image.begin(), image.end());
+		{
+			std::lock_guard<std::mutex> lock(mutex);
+			queue.push_back(std::move(queued));
+		}
+		pushed.notify_one();
+	}
+
+	// waits for the queued frames, false if any of them could not be written
+	bool finish()
+	{
+		{
+			std::lock_guard<std::mutex> lock(mutex);
+			stop = true;
+		}
+		pushed.notify_all();
+		for (std::thread& encoder : encoders) encoder.join();
+		encoders.clear();
+		return !failed;
+	}
+
+private:
+	struct Frame
+	{
+		int number = 0;
+		std::vector<uint32> pixels;
+	};
+
+	void run()
+	{
+		PROFILE_THREAD_NAME("png");
+		while (true)
+		{
+			Frame frame;
+			{
+				std::unique_lock<std::mutex> lock(mutex);
+				pushed.wait(lock, [this]() { return stop || !queue.empty(); });
+				if (queue.empty()) return;
+				frame = std::move(queue.front());
+				queue.pop_front();
+			}
+			taken.notify_one();
+			char path[1024];
+			snprintf(path, sizeof(path), pattern.c_str(), frame.number);
+			bool written;
+			{
+				PROFILE_SCOPE("png");
+				written = stbi_write_png(path, width, height, 4, frame.pixels.data(), width * 4) != 0;
+			}
+			std::lock_guard<std::mutex> lock(mutex);
+			if (!written)
+			{
+				std::cout << "Error writing frame " << path << std::endl;
+				failed = true;
+			}
+			spare.push_back(std::move(frame.pixels));
+		}
+	}
+
+	std::string pattern;
+	int width;
+	int height;
+	std::vector<std::thread> encoders;
+	std::mutex mutex;
+	std::condition_variable pushed;
+	std::condition_variable taken;
+	std::deque<Frame> queue;
+	std::vector<std::vector<uint32>> spare;
+	bool stop = false;
+	bool failed = false;
+};
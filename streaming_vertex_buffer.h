@@ -0,0 +1,152 @@
+#pragma once
+#include <algorithm>
+#include <cstring>
+#include <vector>
+
+#include "defines.h"
+#include "buffer_backend.h"
+
+// vertex buffer for data that changes between frames
+// the buffer holds region_count copies of the vertices in one persistently mapped allocation, the gpu draws from one region
+// while the next one gets written, a fence per region keeps the cpu from overwriting vertices still in flight
+// only the ranges marked with invalidate are copied, and nothing is uploaded while the drawn region is up to date
+// without persistent mapping it falls back to glBufferSubData of the changed ranges into a single region
+// V is the vertex type, the backend sets up the matching attributes
+template <typename V>
+class StreamingVertexBuffer
+{
+public:
+	StreamingVertexBuffer(BufferBackend* backend, const V* data, uint64 num_vertices, int region_count = 3)
+		: backend(backend), num_vertices(num_vertices)
+	{
+		region_count = std::max(1, region_count);
+		std::vector<V> initial;
+		for (int r = 0; r < region_count; r++) initial.insert(initial.end(), data, data + num_vertices);
+		mapped = static_cast<V*>(backend->create_persistent(initial.size() * sizeof(V), initial.data()));
+		if (!mapped)
+		{
+			backend->create_dynamic(num_vertices * sizeof(V), data);
+			region_count = 1;
+		}
+		regions.resize(region_count);
+	}
+
+	virtual ~StreamingVertexBuffer()
+	{
+		for (Region& region : regions)
+		{
+			if (region.fence) backend->delete_fence(region.fence);
+		}
+	}
+
+	// vertices [first, first + count) changed in the source
+	void invalidate(uint64 first, uint64 count)
+	{
+		if (count == 0) return;
+		for (Region& region : regions) add_range(&region.pending, Range{ first, std::min(first + count, num_vertices) });
+	}
+
+	void invalidate_all()
+	{
+		invalidate(0, num_vertices);
+	}
+
+	// copies the invalidated ranges of source into the next region, returns false if nothing had changed
+	bool upload(const V* source)
+	{
+		if (regions[current].pending.empty()) return false;
+		if (!mapped)
+		{
+			for (const Range& range : regions[0].pending)
+			{
+				backend->sub_data(range.first * sizeof(V), (range.last - range.first) * sizeof(V), source + range.first);
+			}
+			regions[0].pending.clear();
+			return true;
+		}
+		int next = (current + 1) % static_cast<int>(regions.size());
+		Region& region = regions[next];
+		if (region.fence)
+		{
+			backend->wait(region.fence);
+			backend->delete_fence(region.fence);
+			region.fence = nullptr;
+		}
+		V* destination = mapped + next * num_vertices;
+		for (const Range& range : region.pending)
+		{
+			memcpy(destination + range.first, source + range.first, (range.last - range.first) * sizeof(V));
+		}
+		region.pending.clear();
+		current = next;
+		return true;
+	}
+
+	void bind()
+	{
+		backend->bind();
+	}
+
+	// call after the draw calls that use getFirst_vertex, the region is only written again once they are done
+	void fence()
+	{
+		if (!mapped) return;
+		Region& region = regions[current];
+		if (region.fence) backend->delete_fence(region.fence);
+		region.fence = backend->fence();
+	}
+
+	// first vertex of the region to draw
+	uint64 getFirst_vertex() const
+	{
+		return current * num_vertices;
+	}
+
+	uint64 getNum_vertices() const
+	{
+		return num_vertices;
+	}
+
+	int getRegion_count() const
+	{
+		return static_cast<int>(regions.size());
+	}
+
+private:
+	struct Range
+	{
+		uint64 first;
+		uint64 last;
+	};
+
+	struct Region
+	{
+		std::vector<Range> pending; // sorted and disjoint
+		void* fence = nullptr;
+	};
+
+	// keeps the list sorted and merges touching ranges, collapses into one range once it gets long
+	static void add_range(std::vector<Range>* ranges, Range range)
+	{
+		if (range.first >= range.last) return;
+		auto it = std::lower_bound(ranges->begin(), ranges->end(), range, [](const Range& a, const Range& b) { return a.last < b.first; });
+		while (it != ranges->end() && it->first <= range.last)
+		{
+			range.first = std::min(range.first, it->first);
+			range.last = std::max(range.last, it->last);
+			it = ranges->erase(it);
+		}
+		ranges->insert(it, range);
+		if (ranges->size() > 32)
+		{
+			Range all{ ranges->front().first, ranges->back().last };
+			ranges->assign(1, all);
+		}
+	}
+
+	BufferBackend* backend;
+	V* mapped = nullptr;
+	uint64 num_vertices;
+	std::vector<Region> regions;
+	int current = 0;
+};
@@ -0,0 +1,39 @@
+// converts the binary streamlines of a headless run to csv or VTK, the format follows the output extension
+// the input is mapped and encoded chunk by chunk, so the points are never read into memory as a whole
+// only needs glm, build it from this file alone
+#include <iostream>
+#include <string>
+
+#include "defines.h"
+#include "mapped_file.h"
+#include "streamline_export.h"
+
+int main(int argc, char** argv)
+{
+	if (argc != 3)
+	{
+		std::cout << "usage: streamline_convert input.bin output.(csv|vtk|vtp|bin)" << std::endl;
+		return 1;
+	}
+	MappedFile input;
+	if (!input.open(argv[1])) return 1;
+	uint64 header[2] = {};
+	if (input.size() >= sizeof(header)) memcpy(header, input.data(), sizeof(header));
+	const uint64 tracer_count = header[0];
+	const uint64 length = header[1];
+	if (input.size() < sizeof(header) || length == 0 || length > INT_MAX
+		|| tracer_count > (input.size() - sizeof(header)) / (length * 3 * sizeof(float))
+		|| input.size() != sizeof(header) + tracer_count * length * 3 * sizeof(float))
+	{
+		std::cout << argv[1] << " is not a binary streamline file" << std::endl;
+		return 1;
+	}
+	const float* points = reinterpret_cast<const float*>(input.data() + sizeof(header));
+
+	std::string output = argv[2];
+	StreamlineFormat format = streamline_format(output);
+	StreamlineExporter exporter;
+	if (!exporter.start(output, format, streamline_source(points, tracer_count, static_cast<int>(length))) || !exporter.wait()) return 1;
+	std::cout << output << ": " << tracer_count << " lines of " << length << " points as " << streamline_format_name(format) << std::endl;
+	return 0;
+}
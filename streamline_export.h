@@ -0,0 +1,484 @@
+#pragma once
+#include <algorithm>
+#include <atomic>
+#include <climits>
+#include <condition_variable>
+#include <cstdio>
+#include <cstring>
+#include <deque>
+#include <fstream>
+#include <functional>
+#include <iostream>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "glm.hpp"
+#include "defines.h"
+#include "thread_pool.h"
+#include "tracer.h"
+
+// writes the tracer polylines for external tools, every line has the same number of points, oldest first
+// chunks of lines are encoded in parallel into small buffers that a writer thread streams to the file in order,
+// at most two batches of chunks are in memory, never a second copy of all points
+//
+// Binary:    uint64 tracer count, uint64 points per tracer, then x y z floats for every point of every tracer
+// Csv:       tracer,point,x,y,z per point
+// VtkLegacy: legacy .vtk polydata, binary big endian, 32 bit indices so at most INT_MAX points
+// VtkXml:    .vtp polydata with the arrays appended raw, little endian and 64 bit indices
+// both VTK formats carry the point parameter (0 oldest, 1 head) as a scalar
+enum class StreamlineFormat
+{
+	Binary,
+	Csv,
+	VtkLegacy,
+	VtkXml
+};
+
+inline const char* streamline_format_name(StreamlineFormat format)
+{
+	switch (format)
+	{
+	case StreamlineFormat::Csv: return "csv";
+	case StreamlineFormat::VtkLegacy: return "vtk";
+	case StreamlineFormat::VtkXml: return "vtp";
+	default: return "bin";
+	}
+}
+
+// from the extension, .csv, .vtk and .vtp, binary otherwise
+inline StreamlineFormat streamline_format(const std::string& path)
+{
+	size_t dot = path.find_last_of('.');
+	std::string extension = dot == std::string::npos ? "" : path.substr(dot + 1);
+	if (extension == "csv") return StreamlineFormat::Csv;
+	if (extension == "vtk") return StreamlineFormat::VtkLegacy;
+	if (extension == "vtp") return StreamlineFormat::VtkXml;
+	return StreamlineFormat::Binary;
+}
+
+// where the exporter reads the lines from, the data has to stay unchanged until the export finished
+struct StreamlineSource
+{
+	size_t tracer_count = 0;
+	int length = 0;                            // points per line
+	std::function<void(size_t, glm::vec3*)> line; // writes the length points of line t
+};
+
+inline StreamlineSource streamline_source(const Trails& trails)
+{
+	StreamlineSource source;
+	source.tracer_count = trails.tracer_count;
+	source.length = trails.length;
+	const Trails* t = &trails;
+	source.line = [t](size_t tracer, glm::vec3* points)
+	{
+		for (int l = 0; l < t->length; l++) points[l] = trail_point(*t, tracer, l);
+	};
+	return source;
+}
+
+// unrolled trails as in a simulation snapshot, length vertices per tracer
+inline StreamlineSource streamline_source(const std::vector<TracerVertex>& vertices, size_t tracer_count, int length)
+{
+	StreamlineSource source;
+	source.tracer_count = tracer_count;
+	source.length = length;
+	const TracerVertex* v = vertices.data();
+	source.line = [v, length](size_t tracer, glm::vec3* points)
+	{
+		const TracerVertex* line = v + tracer * length;
+		for (int l = 0; l < length; l++) points[l] = line[l].position;
+	};
+	return source;
+}
+
+// x y z floats per point as in the binary format, e.g. straight from a mapped file
+inline StreamlineSource streamline_source(const float* points, size_t tracer_count, int length)
+{
+	StreamlineSource source;
+	source.tracer_count = tracer_count;
+	source.length = length;
+	source.line = [points, length](size_t tracer, glm::vec3* out)
+	{
+		const float* line = points + tracer * length * 3;
+		for (int l = 0; l < length; l++) out[l] = glm::vec3(line[l * 3], line[l * 3 + 1], line[l * 3 + 2]);
+	};
+	return source;
+}
+
+template <typename T>
+inline void streamline_append(std::string* out, T value)
+{
+	out->append(reinterpret_cast<const char*>(&value), sizeof(T));
+}
+
+// legacy VTK binary data is big endian
+inline void streamline_append_big_endian(std::string* out, uint32 bits)
+{
+	char bytes[4] = { static_cast<char>(bits >> 24), static_cast<char>(bits >> 16), static_cast<char>(bits >> 8), static_cast<char>(bits) };
+	out->append(bytes, 4);
+}
+
+inline void streamline_append_big_endian(std::string* out, float value)
+{
+	uint32 bits;
+	memcpy(&bits, &value, sizeof(bits));
+	streamline_append_big_endian(out, bits);
+}
+
+class StreamlineExporter
+{
+public:
+	// encodes on a pool of its own
+	explicit StreamlineExporter(unsigned int thread_count = 0)
+		: own_pool(new ThreadPool(thread_count)), pool(own_pool.get())
+	{
+	}
+
+	// encodes on pool, which nothing else may use until the export finished
+	explicit StreamlineExporter(ThreadPool* pool)
+		: pool(pool)
+	{
+	}
+
+	StreamlineExporter(const StreamlineExporter&) = delete;
+	StreamlineExporter& operator=(const StreamlineExporter&) = delete;
+
+	virtual ~StreamlineExporter()
+	{
+		wait();
+	}
+
+	// opens path and exports on a background thread, false if the file could not be opened or an export still runs
+	bool start(const std::string& path, StreamlineFormat format, const StreamlineSource& source)
+	{
+		if (isBusy()) return false;
+		wait();
+		if (format == StreamlineFormat::VtkLegacy && source.tracer_count * source.length > static_cast<size_t>(INT_MAX))
+		{
+			std::cout << "Legacy VTK indices are 32 bit, use .vtp for more than " << INT_MAX << " points" << std::endl;
+			return false;
+		}
+		output.open(path, format == StreamlineFormat::Csv ? std::ios::out : std::ios::out | std::ios::binary);
+		if (!output.is_open())
+		{
+			std::cout << "Error writing streamline file " << path << std::endl;
+			return false;
+		}
+		this->path = path;
+		this->source = source;
+		build_passes(format);
+		failed = false;
+		busy = true;
+		exporter = std::thread(&StreamlineExporter::run, this);
+		return true;
+	}
+
+	bool isBusy() const
+	{
+		return busy;
+	}
+
+	// waits for the running export, false if it could not write everything
+	bool wait()
+	{
+		if (!exporter.joinable()) return true;
+		exporter.join();
+		bool good = !failed;
+		if (!good) std::cout << "Error writing streamline file " << path << std::endl;
+		return good;
+	}
+
+private:
+	// a fixed prefix followed by the encoded chunks of lines
+	struct Pass
+	{
+		std::string prefix;
+		std::function<void(size_t, size_t, std::string*)> encode; // lines [begin, end)
+	};
+
+	typedef std::vector<std::string> Batch;
+
+	void build_passes(StreamlineFormat format)
+	{
+		passes.clear();
+		suffix.clear();
+		const StreamlineSource* s = &source;
+		const uint64 length = source.length;
+		const uint64 points = source.tracer_count * length;
+		auto positions = [s](size_t begin, size_t end, std::string* out)
+		{
+			std::vector<glm::vec3> line(s->length);
+			for (size_t t = begin; t < end; t++)
+			{
+				s->line(t, line.data());
+				out->append(reinterpret_cast<const char*>(line.data()), line.size() * sizeof(glm::vec3));
+			}
+		};
+		switch (format)
+		{
+		case StreamlineFormat::Binary:
+		{
+			Pass pass;
+			streamline_append(&pass.prefix, static_cast<uint64>(source.tracer_count));
+			streamline_append(&pass.prefix, length);
+			pass.encode = positions;
+			passes.push_back(pass);
+			break;
+		}
+		case StreamlineFormat::Csv:
+		{
+			Pass pass;
+			pass.prefix = "tracer,point,x,y,z\n";
+			pass.encode = [s](size_t begin, size_t end, std::string* out)
+			{
+				std::vector<glm::vec3> line(s->length);
+				char text[128];
+				for (size_t t = begin; t < end; t++)
+				{
+					s->line(t, line.data());
+					for (int l = 0; l < s->length; l++)
+					{
+						// %g is what an ostream writes for a float by default
+						int n = snprintf(text, sizeof(text), "%llu,%d,%g,%g,%g\n", static_cast<unsigned long long>(t), l, line[l].x, line[l].y, line[l].z);
+						out->append(text, n);
+					}
+				}
+			};
+			passes.push_back(pass);
+			break;
+		}
+		case StreamlineFormat::VtkLegacy:
+		{
+			Pass points_pass;
+			points_pass.prefix = "# vtk DataFile Version 3.0\ncurl noise streamlines\nBINARY\nDATASET POLYDATA\nPOINTS " + std::to_string(points) + " float\n";
+			points_pass.encode = [s](size_t begin, size_t end, std::string* out)
+			{
+				std::vector<glm::vec3> line(s->length);
+				for (size_t t = begin; t < end; t++)
+				{
+					s->line(t, line.data());
+					for (const glm::vec3& p : line)
+					{
+						streamline_append_big_endian(out, p.x);
+						streamline_append_big_endian(out, p.y);
+						streamline_append_big_endian(out, p.z);
+					}
+				}
+			};
+			passes.push_back(points_pass);
+			Pass lines_pass;
+			lines_pass.prefix = "\nLINES " + std::to_string(source.tracer_count) + " " + std::to_string(source.tracer_count * (length + 1)) + "\n";
+			lines_pass.encode = [length](size_t begin, size_t end, std::string* out)
+			{
+				for (size_t t = begin; t < end; t++)
+				{
+					streamline_append_big_endian(out, static_cast<uint32>(length));
+					for (uint64 l = 0; l < length; l++) streamline_append_big_endian(out, static_cast<uint32>(t * length + l));
+				}
+			};
+			passes.push_back(lines_pass);
+			Pass parameter_pass;
+			parameter_pass.prefix = "\nPOINT_DATA " + std::to_string(points) + "\nSCALARS parameter float 1\nLOOKUP_TABLE default\n";
+			parameter_pass.encode = [length](size_t begin, size_t end, std::string* out)
+			{
+				for (size_t t = begin; t < end; t++)
+				{
+					for (uint64 l = 0; l < length; l++) streamline_append_big_endian(out, parameter(l, length));
+				}
+			};
+			passes.push_back(parameter_pass);
+			suffix = "\n";
+			break;
+		}
+		case StreamlineFormat::VtkXml:
+		{
+			// every appended array is its uint64 size in bytes followed by the data
+			const uint64 points_bytes = points * 3 * sizeof(float);
+			const uint64 parameter_bytes = points * sizeof(float);
+			const uint64 connectivity_bytes = points * sizeof(int64);
+			const uint64 offsets_bytes = source.tracer_count * sizeof(int64);
+			uint64 offset = 0;
+			std::string points_offset = std::to_string(offset);
+			offset += sizeof(uint64) + points_bytes;
+			std::string parameter_offset = std::to_string(offset);
+			offset += sizeof(uint64) + parameter_bytes;
+			std::string connectivity_offset = std::to_string(offset);
+			offset += sizeof(uint64) + connectivity_bytes;
+			std::string offsets_offset = std::to_string(offset);
+
+			Pass points_pass;
+			points_pass.prefix = "<?xml version=\"1.0\"?>\n"
+				"<VTKFile type=\"PolyData\" version=\"1.0\" byte_order=\"LittleEndian\" header_type=\"UInt64\">\n"
+				"  <PolyData>\n"
+				"    <Piece NumberOfPoints=\"" + std::to_string(points) + "\" NumberOfVerts=\"0\" NumberOfLines=\"" + std::to_string(source.tracer_count) + "\" NumberOfStrips=\"0\" NumberOfPolys=\"0\">\n"
+				"      <Points>\n"
+				"        <DataArray type=\"Float32\" NumberOfComponents=\"3\" format=\"appended\" offset=\"" + points_offset + "\"/>\n"
+				"      </Points>\n"
+				"      <PointData Scalars=\"parameter\">\n"
+				"        <DataArray type=\"Float32\" Name=\"parameter\" format=\"appended\" offset=\"" + parameter_offset + "\"/>\n"
+				"      </PointData>\n"
+				"      <Lines>\n"
+				"        <DataArray type=\"Int64\" Name=\"connectivity\" format=\"appended\" offset=\"" + connectivity_offset + "\"/>\n"
+				"        <DataArray type=\"Int64\" Name=\"offsets\" format=\"appended\" offset=\"" + offsets_offset + "\"/>\n"
+				"      </Lines>\n"
+				"    </Piece>\n"
+				"  </PolyData>\n"
+				"  <AppendedData encoding=\"raw\">\n"
+				"   _";
+			streamline_append(&points_pass.prefix, points_bytes);
+			points_pass.encode = positions;
+			passes.push_back(points_pass);
+			Pass parameter_pass;
+			streamline_append(&parameter_pass.prefix, parameter_bytes);
+			parameter_pass.encode = [length](size_t begin, size_t end, std::string* out)
+			{
+				for (size_t t = begin; t < end; t++)
+				{
+					for (uint64 l = 0; l < length; l++) streamline_append(out, parameter(l, length));
+				}
+			};
+			passes.push_back(parameter_pass);
+			Pass connectivity_pass;
+			streamline_append(&connectivity_pass.prefix, connectivity_bytes);
+			connectivity_pass.encode = [length](size_t begin, size_t end, std::string* out)
+			{
+				for (int64 i = begin * length; i < static_cast<int64>(end * length); i++) streamline_append(out, i);
+			};
+			passes.push_back(connectivity_pass);
+			Pass offsets_pass;
+			streamline_append(&offsets_pass.prefix, offsets_bytes);
+			offsets_pass.encode = [length](size_t begin, size_t end, std::string* out)
+			{
+				for (size_t t = begin; t < end; t++) streamline_append(out, static_cast<int64>((t + 1) * length));
+			};
+			passes.push_back(offsets_pass);
+			suffix = "\n  </AppendedData>\n</VTKFile>\n";
+			break;
+		}
+		}
+	}
+
+	static float parameter(uint64 l, uint64 length)
+	{
+		return length > 1 ? static_cast<float>(l) / static_cast<float>(length - 1) : 1.0f;
+	}
+
+	// export thread, encodes batch after batch while the writer thread writes the previous one
+	void run()
+	{
+		PROFILE_THREAD_NAME("export");
+		spare.assign(2, Batch());
+		writer = std::thread(&StreamlineExporter::write, this);
+		// about 16k points per chunk, two chunks per thread in a batch
+		const size_t chunk_lines = std::max<size_t>(1, 16384 / std::max(1, source.length));
+		const size_t batch_chunks = 2 * pool->getThread_count();
+		const size_t chunk_count = (source.tracer_count + chunk_lines - 1) / chunk_lines;
+		for (const Pass& pass : passes)
+		{
+			Batch prefix = take_spare();
+			prefix.assign(1, pass.prefix);
+			hand_over(prefix);
+			for (size_t first = 0; first < chunk_count && !failed; first += batch_chunks)
+			{
+				PROFILE_SCOPE("encode");
+				size_t count = std::min(batch_chunks, chunk_count - first);
+				Batch batch = take_spare();
+				batch.resize(count);
+				pool->parallel_for(count, 1, [&](size_t begin, size_t end)
+				{
+					for (size_t c = begin; c < end; c++)
+					{
+						size_t line_begin = (first + c) * chunk_lines;
+						size_t line_end = std::min(source.tracer_count, line_begin + chunk_lines);
+						batch[c].clear();
+						pass.encode(line_begin, line_end, &batch[c]);
+					}
+				});
+				hand_over(batch);
+			}
+		}
+		Batch last = take_spare();
+		last.assign(1, suffix);
+		hand_over(last);
+		{
+			std::lock_guard<std::mutex> lock(mutex);
+			done = true;
+		}
+		handed.notify_one();
+		writer.join();
+		output.close();
+		if (output.fail()) failed = true;
+		done = false;
+		busy = false;
+	}
+
+	// writer thread, the file in the order the batches were handed over
+	void write()
+	{
+		PROFILE_THREAD_NAME("export writer");
+		while (true)
+		{
+			Batch batch;
+			{
+				std::unique_lock<std::mutex> lock(mutex);
+				handed.wait(lock, [this]() { return done || !queue.empty(); });
+				if (queue.empty()) return;
+				batch.swap(queue.front());
+				queue.pop_front();
+			}
+			{
+				PROFILE_SCOPE("write");
+				for (const std::string& chunk : batch) output.write(chunk.data(), chunk.size());
+			}
+			if (!output.good()) failed = true;
+			{
+				std::lock_guard<std::mutex> lock(mutex);
+				spare.push_back(std::move(batch));
+			}
+			returned.notify_one();
+		}
+	}
+
+	// a batch the writer is done with, the chunk strings keep their capacity
+	Batch take_spare()
+	{
+		std::unique_lock<std::mutex> lock(mutex);
+		returned.wait(lock, [this]() { return !spare.empty(); });
+		Batch batch;
+		batch.swap(spare.back());
+		spare.pop_back();
+		return batch;
+	}
+
+	void hand_over(Batch& batch)
+	{
+		{
+			std::lock_guard<std::mutex> lock(mutex);
+			queue.push_back(std::move(batch));
+		}
+		handed.notify_one();
+	}
+
+	std::unique_ptr<ThreadPool> own_pool;
+	ThreadPool* pool;
+	std::string path;
+	StreamlineSource source;
+	std::vector<Pass> passes;
+	std::string suffix;
+	std::ofstream output; // writer thread while an export runs
+	std::thread exporter;
+	std::thread writer;
+	std::atomic<bool> busy{ false };
+	std::atomic<bool> failed{ false };
+
+	std::mutex mutex;
+	std::condition_variable handed;
+	std::condition_variable returned;
+	std::deque<Batch> queue;
+	std::vector<Batch> spare;
+	bool done = false;
+};
@@ -0,0 +1,181 @@
+#pragma once
+#include <algorithm>
+#include <atomic>
+#include <cassert>
+#include <condition_variable>
+#include <cstdint>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+#include "profiler.h"
+
+// long lived workers for parallel_for, every thread owns a queue of chunks and steals from the others once it is empty
+class ThreadPool
+{
+public:
+	// thread_count 0 uses every hardware thread, the thread calling parallel_for counts as one of them
+	explicit ThreadPool(unsigned int thread_count = 0)
+	{
+		if (thread_count == 0) thread_count = std::max(1u, std::thread::hardware_concurrency());
+		this->thread_count = thread_count;
+		queues.reset(new WorkQueue[thread_count]);
+		for (unsigned int i = 1; i < thread_count; i++)
+		{
+			workers.push_back(std::thread(&ThreadPool::worker, this, i));
+		}
+	}
+
+	virtual ~ThreadPool()
+	{
+		{
+			std::lock_guard<std::mutex> lock(state_mutex);
+			stop = true;
+		}
+		wake.notify_all();
+		for (std::thread& thread : workers)
+		{
+			thread.join();
+		}
+	}
+
+	// calls fn(begin, end) for chunks of chunk_size covering [0, count) and returns once all of them are done
+	// jobs run one at a time: fn must not call parallel_for itself, that waits on job_mutex forever, and must not
+	// throw, an exception on a worker ends the process
+	// profile_name, a string literal, times the chunks each thread ran as one event per thread instead of one per chunk
+	void parallel_for(size_t count, size_t chunk_size, const std::function<void(size_t, size_t)>& fn, const char* profile_name = nullptr)
+	{
+		assert(!inside_job() && "parallel_for called from inside a parallel_for job");
+		if (count == 0) return;
+		std::lock_guard<std::mutex> job_lock(job_mutex);
+		chunk_size = std::max<size_t>(1, chunk_size);
+		size_t chunk_count = (count + chunk_size - 1) / chunk_size;
+		{
+			std::lock_guard<std::mutex> lock(state_mutex);
+			task = &fn;
+			this->profile_name = profile_name;
+		}
+		remaining = chunk_count;
+		// every queue starts with a contiguous block so neighbouring chunks stay on one thread unless they get stolen
+		for (unsigned int q = 0; q < thread_count; q++)
+		{
+			size_t first = chunk_count * q / thread_count;
+			size_t last = chunk_count * (q + 1) / thread_count;
+			std::lock_guard<std::mutex> lock(queues[q].mutex);
+			for (size_t c = first; c < last; c++)
+			{
+				queues[q].chunks.push_back(Chunk{ c * chunk_size, std::min(count, (c + 1) * chunk_size) });
+			}
+		}
+		{
+			std::lock_guard<std::mutex> lock(state_mutex);
+			generation++;
+		}
+		wake.notify_all();
+		run(0);
+		std::unique_lock<std::mutex> lock(state_mutex);
+		finished.wait(lock, [this]() { return remaining == 0; });
+		task = nullptr;
+		this->profile_name = nullptr;
+	}
+
+	unsigned int getThread_count()
+	{
+		return thread_count;
+	}
+
+private:
+	struct Chunk
+	{
+		size_t begin;
+		size_t end;
+	};
+
+	struct WorkQueue
+	{
+		std::mutex mutex;
+		std::deque<Chunk> chunks;
+	};
+
+	void worker(unsigned int index)
+	{
+		PROFILE_THREAD_NAME("worker " + std::to_string(index));
+		uint64_t seen = 0;
+		while (true)
+		{
+			{
+				std::unique_lock<std::mutex> lock(state_mutex);
+				wake.wait(lock, [this, seen]() { return stop || generation != seen; });
+				if (stop) return;
+				seen = generation;
+			}
+			run(index);
+		}
+	}
+
+	// set while this thread runs a chunk of any pool, only read by the assert in parallel_for
+	static bool& inside_job()
+	{
+		static thread_local bool inside = false;
+		return inside;
+	}
+
+	// drains the own queue from the front, then steals from the back of the others
+	void run(unsigned int index)
+	{
+		Chunk chunk;
+		if (!pop(index, chunk) && !steal(index, chunk)) return;
+		// the job lasts until this thread's first chunk is done, so profile_name is still the job's
+		PROFILE_SCOPE(profile_name);
+		do
+		{
+			inside_job() = true;
+			(*task)(chunk.begin, chunk.end);
+			inside_job() = false;
+			if (remaining.fetch_sub(1) == 1)
+			{
+				std::lock_guard<std::mutex> lock(state_mutex);
+				finished.notify_all();
+			}
+		} while (pop(index, chunk) || steal(index, chunk));
+	}
+
+	bool pop(unsigned int index, Chunk& chunk)
+	{
+		std::lock_guard<std::mutex> lock(queues[index].mutex);
+		if (queues[index].chunks.empty()) return false;
+		chunk = queues[index].chunks.front();
+		queues[index].chunks.pop_front();
+		return true;
+	}
+
+	bool steal(unsigned int index, Chunk& chunk)
+	{
+		for (unsigned int i = 1; i < thread_count; i++)
+		{
+			WorkQueue& victim = queues[(index + i) % thread_count];
+			std::lock_guard<std::mutex> lock(victim.mutex);
+			if (victim.chunks.empty()) continue;
+			chunk = victim.chunks.back();
+			victim.chunks.pop_back();
+			return true;
+		}
+		return false;
+	}
+
+	unsigned int thread_count;
+	std::unique_ptr<WorkQueue[]> queues;
+	std::vector<std::thread> workers;
+	std::mutex job_mutex;
+	std::mutex state_mutex;
+	std::condition_variable wake;
+	std::condition_variable finished;
+	const std::function<void(size_t, size_t)>* task = nullptr;
+	const char* profile_name = nullptr;
+	std::atomic<size_t> remaining{ 0 };
+	uint64_t generation = 0;
+	bool stop = false;
+};
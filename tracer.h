@@ -0,0 +1,195 @@
+#pragma once
+#include <vector>
+
+#include "glm.hpp"
+#include "defines.h"
+#include "particles.h"
+#include "curl_noise.h"
+#include "velocity_grid.h"
+#include "integrator.h"
+#include "profiler.h"
+
+// no SDL or OpenGL in here, the tracers are shared between main.cpp and the headless tracer
+
+// the simulation only advances the ParticleStore, the trails keep the last l_trace_count + 1 particle positions
+// for rendering, a circular buffer per tracer
+// tracers are numbered (i * j_trace_count + j) * k_trace_count + k
+struct Trails
+{
+	int l_trace_count;          // line segments per trail
+	int length;                 // points per trail, l_trace_count + 1
+	size_t tracer_count;
+	std::vector<glm::vec3> points; // tracer_count * length
+	std::vector<uint32> head;      // newest point of every tracer, the oldest one follows it
+};
+
+inline void init_tracers(ParticleStore* particles, Trails* trails, int i_trace_count, int j_trace_count, int k_trace_count, int l_trace_count, float tracing_width, float tracing_height)
+{
+	trails->l_trace_count = l_trace_count;
+	trails->length = l_trace_count + 1;
+	trails->tracer_count = static_cast<size_t>(i_trace_count) * j_trace_count * k_trace_count;
+	trails->points.resize(trails->tracer_count * trails->length);
+	trails->head.assign(trails->tracer_count, l_trace_count);
+	init_particles(particles, trails->tracer_count);
+	size_t t = 0;
+	for (int i = 0; i < i_trace_count; i++)
+	{
+		for (int j = 0; j < j_trace_count; j++)
+		{
+			for (int k = 0; k < k_trace_count; k++)
+			{
+				// start as a vertical line, the oldest point on top
+				for (int l = 0; l < trails->length; l++)
+				{
+					trails->points[t * trails->length + l] = glm::vec3((tracing_width / 2.0f) - i * (tracing_width / i_trace_count) + 0.1f,
+						(tracing_height / 2.0f) - k * (tracing_height / k_trace_count) - 0.1f * l + 0.1f,
+						(tracing_width / 2.0f) - j * (tracing_width / i_trace_count) + 0.1f);
+				}
+				set_particle_position(particles, t, trails->points[t * trails->length + l_trace_count]);
+				t++;
+			}
+		}
+	}
+}
+
+// point l of a trail, 0 is the oldest and l_trace_count the head
+inline const glm::vec3& trail_point(const Trails& trails, size_t t, int l)
+{
+	int index = static_cast<int>(trails.head[t]) + 1 + l;
+	if (index >= trails.length) index -= trails.length;
+	return trails.points[t * trails.length + index];
+}
+
+// moves particle t by step_size of simulated time, returns the number of field evaluations
+template <typename Field>
+inline uint64 advance_particle(ParticleStore* particles, size_t t, float step_size, const IntegratorSettings& settings, Field& field)
+{
+	glm::vec3 p = particle_position(*particles, t);
+	uint64 evaluations = evaluations_per_step(settings.integrator);
+	switch (settings.integrator)
+	{
+	case Integrator::RK2:
+		p = integrate_rk2(p, step_size, field);
+		break;
+	case Integrator::RK4:
+		p = integrate_rk4(p, step_size, field);
+		break;
+	case Integrator::RK45:
+	{
+		// RK45 splits the step into adaptive substeps, the substep size is carried over if the store keeps it
+		const bool adaptive_state = !particles->step.empty();
+		float h = adaptive_state ? particles->step[t] : step_size;
+		evaluations = integrate_rk45(&p, step_size, &h, settings, field);
+		if (adaptive_state) particles->step[t] = h;
+		break;
+	}
+	default:
+		p = integrate_euler(p, step_size, field);
+		break;
+	}
+	set_particle_position(particles, t, p);
+	return evaluations;
+}
+
+// advances the particles [begin, end) by step_size of simulated time, expired particles respawn at their seed
+// returns the number of field evaluations
+inline uint64 calculate_new_positions(size_t begin, size_t end, ParticleStore* particles, const CompiledScene& scene, float step_size, VelocityGridBlend grid, GridInterpolation interpolation,
+	const IntegratorSettings& settings = IntegratorSettings())
+{
+	uint64 analytic = 0;
+	auto field = [&](const glm::vec3& p)
+	{
+		float pos[3] = { p.x, p.y, p.z };
+		float flowarr[3] = { 0.0f, 0.0f, 0.0f };
+		if (velocity_field_cached(pos, flowarr, scene, grid, interpolation)) analytic++;
+		return glm::vec3(flowarr[0], flowarr[1], flowarr[2]);
+	};
+	uint64 evaluations = 0;
+	for (size_t t = begin; t < end; t++) evaluations += advance_particle(particles, t, step_size, settings, field);
+	PROFILE_ADD(ProfileCounter::IntegrationSteps, end - begin);
+	PROFILE_ADD(ProfileCounter::FieldEvaluations, evaluations);
+	PROFILE_ADD(ProfileCounter::PotentialEvaluations, analytic * SCENE_POTENTIALS_PER_FIELD);
+	age_particles(begin, end, particles, step_size);
+	return evaluations;
+}
+
+// the same for the particles indices[0, count), each by its own dt, for steps that only advance some of them
+inline uint64 calculate_new_positions(const uint32* indices, const float* dt, size_t count, ParticleStore* particles, const CompiledScene& scene, VelocityGridBlend grid,
+	GridInterpolation interpolation, const IntegratorSettings& settings = IntegratorSettings())
+{
+	uint64 analytic = 0;
+	auto field = [&](const glm::vec3& p)
+	{
+		float pos[3] = { p.x, p.y, p.z };
+		float flowarr[3] = { 0.0f, 0.0f, 0.0f };
+		if (velocity_field_cached(pos, flowarr, scene, grid, interpolation)) analytic++;
+		return glm::vec3(flowarr[0], flowarr[1], flowarr[2]);
+	};
+	const bool lifetime = has_lifetime(*particles);
+	uint64 evaluations = 0;
+	for (size_t i = 0; i < count; i++)
+	{
+		evaluations += advance_particle(particles, indices[i], dt[i], settings, field);
+		if (lifetime) age_particle(particles, indices[i], dt[i]);
+	}
+	PROFILE_ADD(ProfileCounter::IntegrationSteps, count);
+	PROFILE_ADD(ProfileCounter::FieldEvaluations, evaluations);
+	PROFILE_ADD(ProfileCounter::PotentialEvaluations, analytic * SCENE_POTENTIALS_PER_FIELD);
+	return evaluations;
+}
+
+// appends the position of particle t to its trail, the oldest point gets overwritten
+// a respawned particle restarts its trail at the seed
+inline void record_trail(size_t t, const ParticleStore& particles, Trails* trails)
+{
+	glm::vec3* trail = &trails->points[t * trails->length];
+	glm::vec3 position = particle_position(particles, t);
+	if (has_lifetime(particles) && particles.age[t] == 0.0f)
+	{
+		for (int l = 0; l < trails->length; l++) trail[l] = position;
+		return;
+	}
+	uint32 head = trails->head[t];
+	head = (head + 1 == static_cast<uint32>(trails->length)) ? 0 : head + 1;
+	trail[head] = position;
+	trails->head[t] = head;
+}
+
+inline void record_trails(size_t begin, size_t end, const ParticleStore& particles, Trails* trails)
+{
+	for (size_t t = begin; t < end; t++) record_trail(t, particles, trails);
+}
+
+inline void record_trails(const uint32* indices, size_t count, const ParticleStore& particles, Trails* trails)
+{
+	for (size_t i = 0; i < count; i++) record_trail(indices[i], particles, trails);
+}
+
+// writes the trails [begin, end) as line strips, trails.length vertices per tracer from the oldest point to the head
+inline void unroll_trails(size_t begin, size_t end, const Trails& trails, std::vector<TracerVertex>* vertices)
+{
+	const int l_trace_count = trails.l_trace_count;
+	for (size_t t = begin; t < end; t++)
+	{
+		TracerVertex* line = &(*vertices)[t * trails.length];
+		for (int l = 0; l <= l_trace_count; l++)
+		{
+			line[l] = TracerVertex{ trail_point(trails, t, l), static_cast<float>(l) / static_cast<float>(l_trace_count) };
+		}
+	}
+}
+
+// index that ends a line strip, what GL_PRIMITIVE_RESTART_FIXED_INDEX uses for 32 bit indices
+const uint32 TRACER_RESTART_INDEX = 0xFFFFFFFFu;
+
+// one strip per tracer over the unrolled vertices, each followed by the restart index
+inline void trail_strip_indices(size_t tracer_count, int length, std::vector<uint32>* indices)
+{
+	indices->clear();
+	indices->reserve(tracer_count * (length + 1));
+	for (size_t t = 0; t < tracer_count; t++)
+	{
+		for (int l = 0; l < length; l++) indices->push_back(static_cast<uint32>(t * length + l));
+		indices->push_back(TRACER_RESTART_INDEX);
+	}
+}
@@ -0,0 +1,148 @@
+#pragma once
+#include <algorithm>
+#include <cmath>
+#include <vector>
+
+#include "glm.hpp"
+#include "defines.h"
+#include "particles.h"
+
+// level of detail for the tracer steps: tracers the camera sees up close advance every step, the others every
+// 2nd, 4th, ... step by the time they missed in one combined step, tracers off screen can also be frozen
+// a time budget per step doubles every interval until the estimated cost of a step fits
+
+struct TracerLodSettings
+{
+	bool enabled = false;
+	float near_distance = 15.0f;  // visible tracers closer to the camera than this advance every step
+	float rotor_distance = 8.0f;  // as do visible tracers this close to the rotor
+	int max_level = 3;            // without a budget, the slowest tracers advance every 2^max_level steps
+	bool freeze_offscreen = false; // off screen tracers stop instead of advancing at the slowest rate
+	float budget_ms = 8.0f;       // for the field evaluations of one step, 0 for no budget
+};
+
+// what the render thread saw last, the camera's view projection and its position in world space
+struct TracerLodView
+{
+	glm::mat4 view_projection = glm::mat4(1.0f);
+	glm::vec3 camera_position = glm::vec3(0.0f);
+	glm::vec3 rotor_center = glm::vec3(0.0f);
+};
+
+// level of a tracer that does not advance at all
+const uint8 LOD_FROZEN = 0xFF;
+// the budget can slow every tracer down to one step in 2^LOD_MAX_BUDGET_LEVEL
+const int LOD_MAX_BUDGET_LEVEL = 7;
+
+class TracerLod
+{
+public:
+	void init(size_t tracer_count)
+	{
+		level.assign(tracer_count, 0);
+		owed.assign(tracer_count, 0.0f);
+		due.clear();
+		dt.clear();
+		bias = 0;
+	}
+
+	// level of the tracers [begin, end) from where they are on screen, runs on the worker threads
+	void classify(size_t begin, size_t end, const ParticleStore& particles, const TracerLodView& view, const TracerLodSettings& settings)
+	{
+		const float near2 = settings.near_distance * settings.near_distance;
+		const float rotor2 = settings.rotor_distance * settings.rotor_distance;
+		for (size_t t = begin; t < end; t++)
+		{
+			glm::vec3 p = particle_position(particles, t);
+			glm::vec4 clip = view.view_projection * glm::vec4(p, 1.0f);
+			// a margin of a tenth of the screen, tracers about to come into view are already moving
+			float w = 1.1f * clip.w;
+			bool visible = clip.w > 0.0f && fabsf(clip.x) <= w && fabsf(clip.y) <= w && clip.z <= clip.w;
+			if (!visible)
+			{
+				level[t] = settings.freeze_offscreen ? LOD_FROZEN : static_cast<uint8>(settings.max_level);
+				continue;
+			}
+			// written out, curl_noise.h defines a dot macro that glm::dot would expand
+			glm::vec3 c = p - view.camera_position;
+			glm::vec3 r = p - view.rotor_center;
+			float distance2 = c.x * c.x + c.y * c.y + c.z * c.z;
+			if (distance2 <= near2 || r.x * r.x + r.y * r.y + r.z * r.z <= rotor2)
+			{
+				level[t] = 0;
+				continue;
+			}
+			// one level per doubling of the distance past near_distance
+			int l = 1 + static_cast<int>(0.5f * log2f(distance2 / near2));
+			level[t] = static_cast<uint8>(std::min(l, settings.max_level));
+		}
+	}
+
+	// picks the tracers that advance in this step and by how much, after classify ran for every tracer
+	void schedule(uint64 step, float step_size, const TracerLodSettings& settings)
+	{
+		const int max_level = std::max(0, std::min(settings.max_level, LOD_MAX_BUDGET_LEVEL));
+		// tracers per level, the cost of a bias is the number of updates it leaves per step
+		size_t counts[8] = {};
+		for (uint8 l : level)
+		{
+			if (l != LOD_FROZEN) counts[std::min<int>(l, max_level)]++;
+		}
+		bias = 0;
+		if (settings.budget_ms > 0.0f && ms_per_update > 0.0f)
+		{
+			float updates_in_budget = settings.budget_ms / ms_per_update;
+			for (; bias < LOD_MAX_BUDGET_LEVEL; bias++)
+			{
+				float updates = 0.0f;
+				for (int l = 0; l <= max_level; l++) updates += counts[l] / static_cast<float>(1 << std::min(l + bias, LOD_MAX_BUDGET_LEVEL));
+				if (updates <= updates_in_budget) break;
+			}
+		}
+
+		due.clear();
+		dt.clear();
+		for (size_t t = 0; t < level.size(); t++)
+		{
+			if (level[t] == LOD_FROZEN) continue;
+			owed[t] += step_size;
+			uint64 interval = 1ull << std::min(level[t] + bias, LOD_MAX_BUDGET_LEVEL);
+			// the tracer index staggers the tracers of a level over the steps of its interval
+			if (((step + t) & (interval - 1)) != 0) continue;
+			due.push_back(static_cast<uint32>(t));
+			dt.push_back(owed[t]);
+			owed[t] = 0.0f;
+		}
+	}
+
+	// time the due tracers took, the cost per update for the next schedule
+	void report(float ms, size_t updates)
+	{
+		if (updates == 0) return;
+		float sample = ms / static_cast<float>(updates);
+		ms_per_update = ms_per_update > 0.0f ? 0.8f * ms_per_update + 0.2f * sample : sample;
+	}
+
+	const std::vector<uint32>& getDue() const
+	{
+		return due;
+	}
+
+	const std::vector<float>& getDt() const
+	{
+		return dt;
+	}
+
+	int getBias() const
+	{
+		return bias;
+	}
+
+private:
+	std::vector<uint8> level;
+	std::vector<float> owed; // simulated time since the tracer last advanced
+	std::vector<uint32> due;
+	std::vector<float> dt;
+	int bias = 0;
+	float ms_per_update = 0.0f;
+};
@@ -0,0 +1,434 @@
+#pragma once
+#include <algorithm>
+#include <atomic>
+#include <cmath>
+#include <condition_variable>
+#include <cstring>
+#include <deque>
+#include <fstream>
+#include <iostream>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+#include "glm.hpp"
+#include "defines.h"
+#include "mapped_file.h"
+#include "particles.h"
+#include "tracer.h"
+
+// recorded particle positions of a run, one frame per simulation step
+// header | frames | seek index, every position is quantized to 16 bits per component inside of the header bounds,
+// positions outside of them are clamped to the bounds
+// every TRJ_KEYFRAME_INTERVAL-th frame is a keyframe with the raw quantized x, y and z arrays, the frames in between
+// store the difference to the previous frame per component as zigzag varints in the same order, so a tracer that
+// did not move costs 3 bytes and one that did usually 3 to 6
+// the seek index at the end holds the offset of every frame and the end of the last one, a seek decodes the
+// keyframe before the frame and the deltas after it
+#define TRJ_VERSION 1
+#define TRJ_KEYFRAME_INTERVAL 64
+
+struct TrjHeader
+{
+	char magic[4];           // "TRJ1"
+	uint32 version;
+	uint32 tracer_count;
+	uint32 keyframe_interval;
+	uint64 frame_count;
+	uint64 index_offset;     // frame_count + 1 uint64 frame offsets, 0 while the recording is not closed
+	float bounds_min[3];
+	float bounds_max[3];
+	float step_size;         // simulated time between frames
+	uint32 reserved;
+};
+
+static_assert(sizeof(TrjHeader) == 64, "TrjHeader is part of the file format");
+
+// the tracing volume grown by margin on every side, tracers leave the volume with the downwash
+inline void trajectory_bounds(float tracing_width, float tracing_height, float margin, float min[3], float max[3])
+{
+	min[0] = min[2] = -tracing_width / 2.0f - margin;
+	max[0] = max[2] = tracing_width / 2.0f + margin;
+	min[1] = -tracing_height / 2.0f - margin;
+	max[1] = tracing_height / 2.0f + margin;
+}
+
+inline uint16 trj_quantize(float x, float min, float scale)
+{
+	float q = (x - min) * scale + 0.5f;
+	// written so NaN ends up at the lower bound
+	if (!(q > 0.0f)) return 0;
+	if (q >= 65535.0f) return 65535;
+	return static_cast<uint16>(q);
+}
+
+inline uint8* trj_put_varint(uint8* out, uint32 value)
+{
+	while (value >= 0x80)
+	{
+		*out++ = static_cast<uint8>(value | 0x80);
+		value >>= 7;
+	}
+	*out++ = static_cast<uint8>(value);
+	return out;
+}
+
+// streams frames to a .trj file, quantizing happens on the caller's thread, delta encoding and writing on a
+// writer thread so a step only pays for one pass over the positions
+class TrajectoryWriter
+{
+public:
+	TrajectoryWriter() {}
+	TrajectoryWriter(const TrajectoryWriter&) = delete;
+	TrajectoryWriter& operator=(const TrajectoryWriter&) = delete;
+
+	virtual ~TrajectoryWriter()
+	{
+		close();
+	}
+
+	bool open(const char* path, size_t tracer_count, const float bounds_min[3], const float bounds_max[3], float step_size)
+	{
+		close();
+		output.open(path, std::ios::out | std::ios::binary | std::ios::trunc);
+		if (!output.is_open())
+		{
+			std::cout << "Could not open " << path << " for writing" << std::endl;
+			return false;
+		}
+		memset(&header, 0, sizeof(header));
+		memcpy(header.magic, "TRJ1", 4);
+		header.version = TRJ_VERSION;
+		header.tracer_count = static_cast<uint32>(tracer_count);
+		header.keyframe_interval = TRJ_KEYFRAME_INTERVAL;
+		header.step_size = step_size;
+		for (int k = 0; k < 3; k++)
+		{
+			header.bounds_min[k] = bounds_min[k];
+			header.bounds_max[k] = bounds_max[k];
+			scale[k] = 65535.0f / std::max(bounds_max[k] - bounds_min[k], 1e-6f);
+		}
+		// rewritten with the frame count and the index on close
+		output.write(reinterpret_cast<const char*>(&header), sizeof(header));
+		frame_offsets.clear();
+		previous.assign(tracer_count * 3, 0);
+		free_frames.clear();
+		queue.clear();
+		stop = false;
+		failed = false;
+		pushed = 0;
+		writer = std::thread(&TrajectoryWriter::run, this);
+		return true;
+	}
+
+	bool isOpen() const
+	{
+		return writer.joinable();
+	}
+
+	// quantizes the current positions as the next frame, waits while the writer is max_queued frames behind
+	void push(const ParticleStore& particles)
+	{
+		if (!isOpen() || particles.count != header.tracer_count) return;
+		std::vector<uint16> frame;
+		{
+			std::unique_lock<std::mutex> lock(mutex);
+			written.wait(lock, [this]() { return queue.size() < max_queued; });
+			if (!free_frames.empty())
+			{
+				frame.swap(free_frames.back());
+				free_frames.pop_back();
+			}
+		}
+		size_t n = particles.count;
+		frame.resize(n * 3);
+		const std::vector<float>* components[3] = { &particles.x, &particles.y, &particles.z };
+		for (int k = 0; k < 3; k++)
+		{
+			const float* x = components[k]->data();
+			uint16* q = &frame[k * n];
+			for (size_t i = 0; i < n; i++) q[i] = trj_quantize(x[i], header.bounds_min[k], scale[k]);
+		}
+		{
+			std::lock_guard<std::mutex> lock(mutex);
+			queue.push_back(std::move(frame));
+		}
+		pushed++;
+		queued.notify_one();
+	}
+
+	uint64 getFrame_count() const
+	{
+		return pushed;
+	}
+
+	// writes the outstanding frames and the seek index, false if any write failed
+	bool close()
+	{
+		if (!isOpen()) return true;
+		{
+			std::lock_guard<std::mutex> lock(mutex);
+			stop = true;
+		}
+		queued.notify_one();
+		writer.join();
+		uint64 end = static_cast<uint64>(output.tellp());
+		frame_offsets.push_back(end);
+		header.frame_count = frame_offsets.size() - 1;
+		// aligned, the reader uses the index straight from the mapping
+		const char padding[sizeof(uint64)] = {};
+		output.write(padding, (sizeof(uint64) - end % sizeof(uint64)) % sizeof(uint64));
+		header.index_offset = static_cast<uint64>(output.tellp());
+		output.write(reinterpret_cast<const char*>(frame_offsets.data()), frame_offsets.size() * sizeof(uint64));
+		output.seekp(0);
+		output.write(reinterpret_cast<const char*>(&header), sizeof(header));
+		bool good = !failed && output.good();
+		output.close();
+		if (!good) std::cout << "Error writing trajectory file" << std::endl;
+		return good;
+	}
+
+private:
+	void run()
+	{
+		std::vector<uint8> encoded;
+		while (true)
+		{
+			std::vector<uint16> frame;
+			{
+				std::unique_lock<std::mutex> lock(mutex);
+				queued.wait(lock, [this]() { return stop || !queue.empty(); });
+				if (queue.empty()) return;
+				frame.swap(queue.front());
+				queue.pop_front();
+			}
+			written.notify_one();
+
+			frame_offsets.push_back(static_cast<uint64>(output.tellp()));
+			if ((frame_offsets.size() - 1) % TRJ_KEYFRAME_INTERVAL == 0)
+			{
+				output.write(reinterpret_cast<const char*>(frame.data()), frame.size() * sizeof(uint16));
+			}
+			else
+			{
+				// at most 3 bytes per component
+				encoded.resize(frame.size() * 3);
+				uint8* out = encoded.data();
+				for (size_t i = 0; i < frame.size(); i++)
+				{
+					int16 delta = static_cast<int16>(static_cast<uint16>(frame[i] - previous[i]));
+					uint32 zigzag = static_cast<uint16>((delta << 1) ^ (delta >> 15));
+					out = trj_put_varint(out, zigzag);
+				}
+				output.write(reinterpret_cast<const char*>(encoded.data()), out - encoded.data());
+			}
+			if (!output.good()) failed = true;
+			previous.swap(frame);
+
+			std::lock_guard<std::mutex> lock(mutex);
+			free_frames.push_back(std::move(frame));
+		}
+	}
+
+	const size_t max_queued = 4;
+
+	std::ofstream output;
+	TrjHeader header;
+	float scale[3];
+	std::vector<uint64> frame_offsets; // writer thread until it is joined
+	std::vector<uint16> previous;      // writer thread
+	std::thread writer;
+	std::atomic<bool> failed{ false };
+	uint64 pushed = 0;
+
+	std::mutex mutex;
+	std::condition_variable queued;
+	std::condition_variable written;
+	std::deque<std::vector<uint16>> queue;
+	std::vector<std::vector<uint16>> free_frames;
+	bool stop = false;
+};
+
+// maps a .trj file and decodes its frames, reading the next frame only applies one delta
+class TrajectoryReader
+{
+public:
+	bool open(const char* path)
+	{
+		frame = -1;
+		index = nullptr;
+		if (!file.open(path)) return false;
+		const uint8* data = file.data();
+		uint64 size = file.size();
+		if (size < sizeof(TrjHeader) || memcmp(data, "TRJ1", 4) != 0)
+		{
+			std::cout << path << " is not a trajectory file" << std::endl;
+			return false;
+		}
+		memcpy(&header, data, sizeof(TrjHeader));
+		if (header.version != TRJ_VERSION || header.keyframe_interval == 0)
+		{
+			std::cout << path << " has trajectory version " << header.version << ", expected " << TRJ_VERSION << std::endl;
+			return false;
+		}
+		if (header.index_offset == 0)
+		{
+			std::cout << path << " was not closed, the recording has no seek index" << std::endl;
+			return false;
+		}
+		if (header.index_offset % sizeof(uint64) != 0 || header.index_offset > size
+			|| (size - header.index_offset) / sizeof(uint64) != header.frame_count + 1)
+		{
+			std::cout << path << " has a broken seek index" << std::endl;
+			return false;
+		}
+		index = reinterpret_cast<const uint64*>(data + header.index_offset);
+		// offsets grow and keyframes hold exactly the raw arrays, so decoding never reads outside of a frame
+		uint64 keyframe_size = static_cast<uint64>(header.tracer_count) * 3 * sizeof(uint16);
+		for (uint64 f = 0; f < header.frame_count; f++)
+		{
+			bool keyframe = f % header.keyframe_interval == 0;
+			if (index[f] < sizeof(TrjHeader) || index[f + 1] < index[f] || index[f + 1] > header.index_offset
+				|| (keyframe && index[f + 1] - index[f] != keyframe_size))
+			{
+				std::cout << path << " has a broken seek index at frame " << f << std::endl;
+				return false;
+			}
+		}
+		for (int k = 0; k < 3; k++) step[k] = (header.bounds_max[k] - header.bounds_min[k]) / 65535.0f;
+		state.assign(static_cast<size_t>(header.tracer_count) * 3, 0);
+		return true;
+	}
+
+	// decodes frame f into the reader's state, false if f is out of range or the frame data is corrupt
+	bool seek(uint64 f)
+	{
+		if (f >= header.frame_count) return false;
+		if (frame < 0 || f < static_cast<uint64>(frame) || f - f % header.keyframe_interval > static_cast<uint64>(frame))
+		{
+			uint64 keyframe = f - f % header.keyframe_interval;
+			memcpy(state.data(), file.data() + index[keyframe], state.size() * sizeof(uint16));
+			frame = static_cast<int64>(keyframe);
+		}
+		while (static_cast<uint64>(frame) < f)
+		{
+			frame++;
+			if (!apply_delta(static_cast<uint64>(frame)))
+			{
+				std::cout << "Trajectory frame " << frame << " is corrupt" << std::endl;
+				frame = -1;
+				return false;
+			}
+		}
+		return true;
+	}
+
+	// positions of the current frame
+	void getPositions(ParticleStore* particles) const
+	{
+		size_t n = header.tracer_count;
+		if (particles->count != n) init_particles(particles, n);
+		std::vector<float>* components[3] = { &particles->x, &particles->y, &particles->z };
+		for (int k = 0; k < 3; k++)
+		{
+			const uint16* q = &state[k * n];
+			float* x = components[k]->data();
+			for (size_t i = 0; i < n; i++) x[i] = header.bounds_min[k] + q[i] * step[k];
+		}
+	}
+
+	// largest distance between the current frame and particles in quantization steps, positions outside of the
+	// bounds are measured from the bound they were clamped to, so a faithful recording stays within half a step
+	float getError(const ParticleStore& particles) const
+	{
+		size_t n = header.tracer_count;
+		if (particles.count != n) return INFINITY;
+		const std::vector<float>* components[3] = { &particles.x, &particles.y, &particles.z };
+		float error = 0.0f;
+		for (int k = 0; k < 3; k++)
+		{
+			const uint16* q = &state[k * n];
+			const float* x = components[k]->data();
+			for (size_t i = 0; i < n; i++)
+			{
+				// NaN was written as the lower bound
+				float clamped = x[i] >= header.bounds_min[k] ? std::min(x[i], header.bounds_max[k]) : header.bounds_min[k];
+				error = std::max(error, fabsf(header.bounds_min[k] + q[i] * step[k] - clamped) / step[k]);
+			}
+		}
+		return error;
+	}
+
+	size_t getTracer_count() const
+	{
+		return header.tracer_count;
+	}
+
+	uint64 getFrame_count() const
+	{
+		return header.frame_count;
+	}
+
+	int64 getFrame() const
+	{
+		return frame;
+	}
+
+	float getStep_size() const
+	{
+		return header.step_size;
+	}
+
+private:
+	bool apply_delta(uint64 f)
+	{
+		const uint8* in = file.data() + index[f];
+		const uint8* end = file.data() + index[f + 1];
+		for (uint16& q : state)
+		{
+			uint32 zigzag = 0;
+			for (int shift = 0;; shift += 7)
+			{
+				if (in == end || shift > 14) return false;
+				uint8 byte = *in++;
+				zigzag |= static_cast<uint32>(byte & 0x7F) << shift;
+				if (!(byte & 0x80)) break;
+			}
+			int16 delta = static_cast<int16>((zigzag >> 1) ^ (0u - (zigzag & 1)));
+			q = static_cast<uint16>(q + delta);
+		}
+		return in == end;
+	}
+
+	MappedFile file;
+	TrjHeader header;
+	const uint64* index = nullptr;
+	float step[3];
+	std::vector<uint16> state; // quantized x, y and z arrays of the current frame
+	int64 frame = -1;
+};
+
+// trails collapsed to the current positions, where a replay starts or after it jumped
+inline void init_replay_trails(const ParticleStore& particles, Trails* trails, int l_trace_count)
+{
+	trails->l_trace_count = l_trace_count;
+	trails->length = l_trace_count + 1;
+	trails->tracer_count = particles.count;
+	trails->points.resize(trails->tracer_count * trails->length);
+	trails->head.assign(trails->tracer_count, l_trace_count);
+	for (size_t t = 0; t < particles.count; t++)
+	{
+		glm::vec3 position = particle_position(particles, t);
+		for (int l = 0; l < trails->length; l++) trails->points[t * trails->length + l] = position;
+	}
+}
+
+// appends the replayed positions of the tracers [begin, end) that moved since the last frame, tracers that were
+// frozen or skipped by the level of detail keep their trails like in the recorded run
+inline void record_replay_trails(size_t begin, size_t end, const ParticleStore& particles, Trails* trails)
+{
+	for (size_t t = begin; t < end; t++)
+	{
+		if (particle_position(particles, t) != trail_point(*trails, t, trails->l_trace_count)) record_trail(t, particles, trails);
+	}
+}
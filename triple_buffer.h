@@ -0,0 +1,51 @@
+#pragma once
+#include <atomic>
+
+// one writer thread hands finished values to one reader thread, neither of them ever waits for the other
+// the writer fills write_buffer and publishes it, the reader picks up the newest published value with update
+template <typename T>
+class TripleBuffer
+{
+public:
+	// writer side, the buffer being filled
+	T& write_buffer()
+	{
+		return buffers[back];
+	}
+
+	// writer side, makes the filled buffer the newest one and continues with the older spare
+	void publish()
+	{
+		int old = middle.exchange(back | DIRTY);
+		back = old & INDEX;
+	}
+
+	// reader side, switches to the newest published buffer, false if there was none since the last call
+	bool update()
+	{
+		if (!(middle.load() & DIRTY)) return false;
+		int old = middle.exchange(front);
+		front = old & INDEX;
+		return true;
+	}
+
+	// reader side, stays valid until the next update
+	const T& read_buffer() const
+	{
+		return buffers[front];
+	}
+
+	// before the threads start, same value in every buffer
+	void fill(const T& value)
+	{
+		for (T& buffer : buffers) buffer = value;
+	}
+
+private:
+	enum { INDEX = 3, DIRTY = 4 };
+
+	T buffers[3];
+	std::atomic<int> middle{ 1 };
+	int back = 2;
+	int front = 0;
+};
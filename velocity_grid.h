@@ -0,0 +1,365 @@
+#pragma once
+#include <algorithm>
+#include <atomic>
+#include <cmath>
+#include <thread>
+#include <vector>
+
+#include "glm.hpp"
+#include "curl_noise.h"
+#include "profiler.h"
+#include "field_scene.h"
+#include "thread_pool.h"
+
+enum class GridInterpolation
+{
+	Trilinear, // velocity at the nodes, cheapest
+	Tricubic   // curl of the catmull-rom interpolated potential, stays divergence free
+};
+
+// velocity_field of a compiled scene baked on a regular lattice for one fixed radius
+class VelocityGrid
+{
+public:
+	void init(glm::vec3 min, glm::vec3 max, int res_x, int res_y, int res_z)
+	{
+		this->min = min;
+		this->max = max;
+		res[0] = res_x;
+		res[1] = res_y;
+		res[2] = res_z;
+		for (int k = 0; k < 3; k++) cell[k] = (max[k] - min[k]) / (res[k] - 1);
+		potential.assign(res[0] * res[1] * res[2] * 3, 0.0f);
+		velocity.assign(res[0] * res[1] * res[2] * 3, 0.0f);
+		radius = -1.0f;
+	}
+
+	// evaluates the analytic field at every node, z slices are split over the pool's threads
+	void build(const CompiledScene& scene, ThreadPool& thread_pool)
+	{
+		thread_pool.parallel_for(res[2], 1, [&](size_t begin, size_t end)
+		{
+			for (int z = static_cast<int>(begin); z < static_cast<int>(end); z++)
+			{
+				for (int y = 0; y < res[1]; y++)
+				{
+					for (int x = 0; x < res[0]; x++)
+					{
+						int index = node(x, y, z) * 3;
+						float pos[3] = { min.x + x * cell[0], min.y + y * cell[1], min.z + z * cell[2] };
+						float jac[3][3];
+						potential_field_jacobian(pos, &potential[index], jac, scene);
+						if (!std::isfinite(jac[0][0] + jac[1][1] + jac[2][2] + jac[0][1] + jac[1][0] + jac[0][2] + jac[2][0] + jac[1][2] + jac[2][1]))
+						{
+							// the rings are not defined on their axis, take the field right next to it
+							pos[0] += 1e-3f * cell[0];
+							potential_field_jacobian(pos, &potential[index], jac, scene);
+						}
+						velocity[index] = jac[1][2] - jac[2][1];
+						velocity[index + 1] = jac[2][0] - jac[0][2];
+						velocity[index + 2] = jac[0][1] - jac[1][0];
+					}
+				}
+			}
+		});
+		this->radius = scene.radius;
+	}
+
+	bool contains(float x[]) const
+	{
+		for (int k = 0; k < 3; k++)
+		{
+			if (x[k] < min[k] || x[k] > max[k]) return false;
+		}
+		return true;
+	}
+
+	// with next, the grid of another radius on the same lattice, both are blended by t on the fly
+	void sample(float x[], float vec[], GridInterpolation interpolation, const VelocityGrid* next = nullptr, float t = 0.0f) const
+	{
+		if (interpolation == GridInterpolation::Tricubic)
+		{
+			sample_tricubic(x, vec, next, t);
+		}
+		else
+		{
+			sample_trilinear(x, vec, next, t);
+		}
+	}
+
+	void sample_trilinear(float x[], float vec[], const VelocityGrid* next = nullptr, float t_next = 0.0f) const
+	{
+		int i[3];
+		float t[3];
+		locate(x, i, t);
+		for (int k = 0; k < 3; k++) vec[k] = 0.0f;
+		for (int c = 0; c < 8; c++)
+		{
+			int dx = c & 1;
+			int dy = (c >> 1) & 1;
+			int dz = (c >> 2) & 1;
+			float w = (dx ? t[0] : 1.0f - t[0]) * (dy ? t[1] : 1.0f - t[1]) * (dz ? t[2] : 1.0f - t[2]);
+			int n = node(i[0] + dx, i[1] + dy, i[2] + dz) * 3;
+			const float* v = &velocity[n];
+			if (next)
+			{
+				const float* u = &next->velocity[n];
+				for (int k = 0; k < 3; k++) vec[k] += w * (v[k] + t_next * (u[k] - v[k]));
+			}
+			else
+			{
+				for (int k = 0; k < 3; k++) vec[k] += w * v[k];
+			}
+		}
+	}
+
+	// blending the potentials keeps the result the curl of one field, so it stays divergence free
+	void sample_tricubic(float x[], float vec[], const VelocityGrid* next = nullptr, float t_next = 0.0f) const
+	{
+		int i[3];
+		float t[3];
+		locate(x, i, t);
+		// catmull-rom weights of the nodes i-1 .. i+2 and their derivatives per axis
+		float w[3][4];
+		float dw[3][4];
+		for (int k = 0; k < 3; k++)
+		{
+			float t1 = t[k];
+			float t2 = t1 * t1;
+			float t3 = t2 * t1;
+			w[k][0] = 0.5f * (-t3 + 2.0f * t2 - t1);
+			w[k][1] = 0.5f * (3.0f * t3 - 5.0f * t2 + 2.0f);
+			w[k][2] = 0.5f * (-3.0f * t3 + 4.0f * t2 + t1);
+			w[k][3] = 0.5f * (t3 - t2);
+			dw[k][0] = 0.5f * (-3.0f * t2 + 4.0f * t1 - 1.0f) / cell[k];
+			dw[k][1] = 0.5f * (9.0f * t2 - 10.0f * t1) / cell[k];
+			dw[k][2] = 0.5f * (-9.0f * t2 + 8.0f * t1 + 1.0f) / cell[k];
+			dw[k][3] = 0.5f * (3.0f * t2 - 2.0f * t1) / cell[k];
+		}
+		int nodes[3][4];
+		for (int k = 0; k < 3; k++)
+		{
+			for (int a = 0; a < 4; a++) nodes[k][a] = CLAMP(i[k] + a - 1, 0, res[k] - 1);
+		}
+		// jac[i][j] = d potential_i / d x_j of the interpolant, separable so every row along x is summed once
+		float jac[3][3] = { { 0.0f } };
+		for (int c = 0; c < 4; c++)
+		{
+			for (int b = 0; b < 4; b++)
+			{
+				int row = node(0, nodes[1][b], nodes[2][c]) * 3;
+				float sum[3] = { 0.0f, 0.0f, 0.0f };
+				float dsum[3] = { 0.0f, 0.0f, 0.0f };
+				for (int a = 0; a < 4; a++)
+				{
+					const float* p = &potential[row + nodes[0][a] * 3];
+					float blended[3] = { p[0], p[1], p[2] };
+					if (next)
+					{
+						const float* q = &next->potential[row + nodes[0][a] * 3];
+						for (int k = 0; k < 3; k++) blended[k] += t_next * (q[k] - p[k]);
+					}
+					for (int k = 0; k < 3; k++)
+					{
+						sum[k] += w[0][a] * blended[k];
+						dsum[k] += dw[0][a] * blended[k];
+					}
+				}
+				float gx = w[1][b] * w[2][c];
+				float gy = dw[1][b] * w[2][c];
+				float gz = w[1][b] * dw[2][c];
+				for (int k = 0; k < 3; k++)
+				{
+					jac[k][0] += dsum[k] * gx;
+					jac[k][1] += sum[k] * gy;
+					jac[k][2] += sum[k] * gz;
+				}
+			}
+		}
+		// same sign convention as velocity_field
+		vec[0] = jac[1][2] - jac[2][1];
+		vec[1] = jac[2][0] - jac[0][2];
+		vec[2] = jac[0][1] - jac[1][0];
+	}
+
+	float getRadius() const
+	{
+		return radius;
+	}
+
+	bool isBuilt() const
+	{
+		return radius >= 0.0f;
+	}
+
+private:
+	int node(int x, int y, int z) const
+	{
+		return (z * res[1] + y) * res[0] + x;
+	}
+
+	// cell containing x and the position inside of it
+	void locate(float x[], int i[], float t[]) const
+	{
+		for (int k = 0; k < 3; k++)
+		{
+			float g = (x[k] - min[k]) / cell[k];
+			i[k] = CLAMP(static_cast<int>(floorf(g)), 0, res[k] - 2);
+			t[k] = CLAMP(g - i[k], 0.0f, 1.0f);
+		}
+	}
+
+	glm::vec3 min;
+	glm::vec3 max;
+	int res[3];
+	float cell[3];
+	std::vector<float> potential;
+	std::vector<float> velocity;
+	float radius = -1.0f;
+};
+
+// the grid a step samples: one baked grid, or the two radius keyframes around the radius and the weight of the second
+struct VelocityGridBlend
+{
+	const VelocityGrid* grid = nullptr;
+	const VelocityGrid* next = nullptr;
+	float t = 0.0f;
+
+	VelocityGridBlend() {}
+	VelocityGridBlend(const VelocityGrid* grid) : grid(grid) {}
+	VelocityGridBlend(const VelocityGrid* grid, const VelocityGrid* next, float t) : grid(grid), next(next), t(t) {}
+
+	bool isValid() const
+	{
+		return grid != nullptr;
+	}
+
+	bool contains(float x[]) const
+	{
+		return grid && grid->contains(x);
+	}
+
+	void sample(float x[], float vec[], GridInterpolation interpolation) const
+	{
+		grid->sample(x, vec, interpolation, next, t);
+	}
+};
+
+// 0 to twice the rotor radius with per_side steps on either side, the field bends at the rotor radius where
+// the first ring stops growing and the second one starts, so it has to be a keyframe
+inline std::vector<float> radius_keyframes(float rotor_radius, int per_side)
+{
+	std::vector<float> radii;
+	for (int i = 0; i <= 2 * per_side; i++) radii.push_back(rotor_radius * i / per_side);
+	return radii;
+}
+
+// velocity grids baked once per radius keyframe, a radius between two keyframes blends them,
+// so moving the vortex ring slider never rebuilds anything
+// keyframes are baked on a background thread, the one nearest to the requested radius first, and are read only
+// once ready, so steps can sample them while the rest is still being built
+class VelocityGridKeyframes
+{
+public:
+	// every keyframe has a full grid, memory is radii.size() * res_x * res_y * res_z * 24 bytes
+	VelocityGridKeyframes(const FieldScene& scene, glm::vec3 min, glm::vec3 max, int res_x, int res_y, int res_z, const std::vector<float>& radii)
+		: scene(scene), radii(radii), grids(radii.size()), ready(radii.size())
+	{
+		for (size_t k = 0; k < grids.size(); k++)
+		{
+			grids[k].init(min, max, res_x, res_y, res_z);
+			ready[k] = false;
+		}
+	}
+
+	~VelocityGridKeyframes()
+	{
+		// a keyframe in progress is finished first
+		stop = true;
+		if (builder.joinable()) builder.join();
+	}
+
+	// radius the simulation is at, the first call starts baking
+	void request(float radius)
+	{
+		wanted_radius = radius;
+		if (!builder.joinable()) builder = std::thread(&VelocityGridKeyframes::build_all, this);
+	}
+
+	// the keyframes around radius, invalid while one of them is not baked yet or radius is outside of the keyframes
+	VelocityGridBlend get(float radius) const
+	{
+		if (radii.empty() || !(radius >= radii.front() && radius <= radii.back())) return VelocityGridBlend();
+		size_t upper = std::upper_bound(radii.begin(), radii.end(), radius) - radii.begin();
+		if (upper == radii.size() || radius == radii[upper - 1])
+		{
+			size_t k = upper - 1;
+			return ready[k].load(std::memory_order_acquire) ? VelocityGridBlend(&grids[k]) : VelocityGridBlend();
+		}
+		size_t lower = upper - 1;
+		if (!ready[lower].load(std::memory_order_acquire) || !ready[upper].load(std::memory_order_acquire)) return VelocityGridBlend();
+		float t = (radius - radii[lower]) / (radii[upper] - radii[lower]);
+		return VelocityGridBlend(&grids[lower], &grids[upper], t);
+	}
+
+	bool isBuilding() const
+	{
+		return builder.joinable() && built < static_cast<int>(grids.size());
+	}
+
+	int getBuilt_count() const
+	{
+		return built;
+	}
+
+	int getKeyframe_count() const
+	{
+		return static_cast<int>(grids.size());
+	}
+
+private:
+	void build_all()
+	{
+		PROFILE_THREAD_NAME("grid keyframes");
+		// a quarter of the machine next to the simulation's pool, the workers live until every keyframe is baked
+		ThreadPool thread_pool(std::max(1u, std::thread::hardware_concurrency() / 4));
+		for (size_t n = 0; n < grids.size() && !stop; n++)
+		{
+			// the slider may have moved since the last keyframe
+			float radius = wanted_radius;
+			size_t nearest = grids.size();
+			for (size_t k = 0; k < grids.size(); k++)
+			{
+				if (ready[k]) continue;
+				if (nearest == grids.size() || fabsf(radii[k] - radius) < fabsf(radii[nearest] - radius)) nearest = k;
+			}
+			CompiledScene compiled;
+			compile_scene(scene, radii[nearest], &compiled);
+			grids[nearest].build(compiled, thread_pool);
+			ready[nearest].store(true, std::memory_order_release);
+			built++;
+		}
+	}
+
+	FieldScene scene;
+	std::vector<float> radii;
+	std::vector<VelocityGrid> grids;
+	std::vector<std::atomic<bool>> ready;
+	std::thread builder;
+	std::atomic<bool> stop{ false };
+	std::atomic<int> built{ 0 };
+	std::atomic<float> wanted_radius{ 0.0f };
+};
+
+// velocity from the baked grid when there is one covering x, the analytic field otherwise
+// returns true if it evaluated the analytic field
+inline bool velocity_field_cached(float x[], float vec[], const CompiledScene& scene, const VelocityGridBlend& grid, GridInterpolation interpolation)
+{
+	if (grid.contains(x))
+	{
+		grid.sample(x, vec, interpolation);
+		return false;
+	}
+	velocity_field(x, vec, scene);
+	return true;
+}
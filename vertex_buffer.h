@@ -3,22 +3,45 @@
 
 #include "defines.h"
 
+// attribute pointers for the buffer bound to GL_ARRAY_BUFFER, position at 0 and color or parameter at 1
+inline void set_vertex_layout(VertexLayout layout)
+{
+	switch (layout)
+	{
+	case VertexLayout::Tracer:
+		glEnableVertexAttribArray(0);
+		glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, sizeof(TracerVertex), (void*) offsetof(struct TracerVertex, position.x));
+		glEnableVertexAttribArray(1);
+		glVertexAttribPointer(1, 1, GL_FLOAT, GL_FALSE, sizeof(TracerVertex), (void*) offsetof(struct TracerVertex, parameter));
+		break;
+	case VertexLayout::Model:
+		// the color is set with glVertexAttrib4f before drawing
+		glEnableVertexAttribArray(0);
+		glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, sizeof(ModelVertex), (void*) offsetof(struct ModelVertex, position.x));
+		glDisableVertexAttribArray(1);
+		break;
+	default:
+		glEnableVertexAttribArray(0);
+		glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, sizeof(Vertex), (void*) offsetof(struct Vertex, position.x));
+		glEnableVertexAttribArray(1);
+		glVertexAttribPointer(1, 4, GL_FLOAT, GL_FALSE, sizeof(Vertex), (void*) offsetof(struct Vertex, color.r));
+		break;
+	}
+}
+
 struct VertexBuffer
 {
-	VertexBuffer(void* data, uint32 numVertices)
+	VertexBuffer(const void* data, uint32 numVertices, VertexLayout layout = VertexLayout::Basic)
 	{
 		glGenVertexArrays(1, &vao);
 		glBindVertexArray(vao);
 
 		glGenBuffers(1, &bufferId);
 		glBindBuffer(GL_ARRAY_BUFFER, bufferId);
-		glBufferData(GL_ARRAY_BUFFER, numVertices * sizeof(Vertex), data, GL_STATIC_DRAW);
+		glBufferData(GL_ARRAY_BUFFER, static_cast<GLsizeiptr>(numVertices) * vertex_stride(layout), data, GL_STATIC_DRAW);
 		num_vertices = numVertices;
 
-		glEnableVertexAttribArray(0);
-		glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, sizeof(Vertex), (void*) offsetof(struct Vertex, position.x));
-		glEnableVertexAttribArray(1);
-		glVertexAttribPointer(1, 4, GL_FLOAT, GL_FALSE, sizeof(Vertex), (void*) offsetof(struct Vertex, color.r));
+		set_vertex_layout(layout);
 
 		glBindVertexArray(0);
 	}
@@ -39,7 +62,7 @@ struct VertexBuffer
 		glBindVertexArray(0);
 	}
 
-	void update(std::vector<Vertex> vertices)
+	void update(const std::vector<Vertex>& vertices)
 	{
 		bind();
 		glBufferSubData(GL_ARRAY_BUFFER, 0, num_vertices * sizeof(Vertex), vertices.data());